@@ -4,9 +4,14 @@
 
 #include "bench.h"
 
+#include "clientversion.h"
+#include "utiltime.h"
+
 #include <iostream>
 #include <sys/time.h>
 
+#include <univalue.h>
+
 using namespace benchmark;
 
 std::map<std::string, BenchFunction> BenchRunner::benchmarks;
@@ -23,17 +28,66 @@ BenchRunner::BenchRunner(std::string name, BenchFunction func)
 }
 
 void
-BenchRunner::RunAll(double elapsedTimeForOne)
+BenchRunner::RunAll(Printer& printer, double elapsedTimeForOne, const std::string& filter)
 {
-    std::cout << "Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
+    printer.header();
 
     for (std::map<std::string,BenchFunction>::iterator it = benchmarks.begin();
          it != benchmarks.end(); ++it) {
 
-        State state(it->first, elapsedTimeForOne);
+        if (!filter.empty() && it->first.find(filter) == std::string::npos)
+            continue;
+
+        State state(it->first, elapsedTimeForOne, printer);
         BenchFunction& func = it->second;
         func(state);
     }
+
+    printer.footer();
+}
+
+void CsvPrinter::header()
+{
+    std::cout << "Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
+}
+
+void CsvPrinter::result(const Result& result)
+{
+    std::cout << result.name << "," << result.count << "," << result.minTime << "," << result.maxTime << "," << result.average << "\n";
+}
+
+void CsvPrinter::footer()
+{
+}
+
+void JsonPrinter::header()
+{
+    results.clear();
+}
+
+void JsonPrinter::result(const Result& result)
+{
+    results.push_back(result);
+}
+
+void JsonPrinter::footer()
+{
+    UniValue benchmarks(UniValue::VARR);
+    for (const Result& result : results) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("name", result.name));
+        entry.push_back(Pair("count", result.count));
+        entry.push_back(Pair("min", result.minTime));
+        entry.push_back(Pair("max", result.maxTime));
+        entry.push_back(Pair("average", result.average));
+        benchmarks.push_back(entry);
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("version", FormatFullVersion()));
+    obj.push_back(Pair("time", GetTime()));
+    obj.push_back(Pair("benchmarks", benchmarks));
+    std::cout << obj.write(2) << "\n";
 }
 
 bool State::KeepRunning()
@@ -63,8 +117,13 @@ bool State::KeepRunning()
     --count;
 
     // Output results
-    double average = (now-beginTime)/count;
-    std::cout << name << "," << count << "," << minTime << "," << maxTime << "," << average << "\n";
+    Result result;
+    result.name = name;
+    result.count = count;
+    result.minTime = minTime;
+    result.maxTime = maxTime;
+    result.average = (now-beginTime)/count;
+    printer.result(result);
 
     return false;
 }
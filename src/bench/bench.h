@@ -7,6 +7,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <boost/function.hpp>
 #include <boost/preprocessor/cat.hpp>
@@ -36,15 +37,18 @@ BENCHMARK(CODE_TO_TIME);
  
 namespace benchmark {
 
+    class Printer;
+
     class State {
         std::string name;
+        Printer& printer;
         double maxElapsed;
         double beginTime;
         double lastTime, minTime, maxTime;
         int64_t count;
         int64_t timeCheckCount;
     public:
-        State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), count(0) {
+        State(std::string _name, double _maxElapsed, Printer& _printer) : name(_name), printer(_printer), maxElapsed(_maxElapsed), count(0) {
             minTime = std::numeric_limits<double>::max();
             maxTime = std::numeric_limits<double>::min();
             timeCheckCount = 1;
@@ -52,6 +56,44 @@ namespace benchmark {
         bool KeepRunning();
     };
 
+    /** Timing of one benchmark, all times in seconds */
+    struct Result {
+        std::string name;
+        int64_t count;
+        double minTime;
+        double maxTime;
+        double average;
+    };
+
+    /** Output format for the benchmark results */
+    class Printer
+    {
+    public:
+        virtual ~Printer() {}
+        virtual void header() = 0;
+        virtual void result(const Result& result) = 0;
+        virtual void footer() = 0;
+    };
+
+    /** One comma separated line per benchmark, printed as soon as it finishes */
+    class CsvPrinter : public Printer
+    {
+    public:
+        void header() override;
+        void result(const Result& result) override;
+        void footer() override;
+    };
+
+    /** A single JSON object holding all results, printed at the end */
+    class JsonPrinter : public Printer
+    {
+        std::vector<Result> results;
+    public:
+        void header() override;
+        void result(const Result& result) override;
+        void footer() override;
+    };
+
     typedef boost::function<void(State&)> BenchFunction;
 
     class BenchRunner
@@ -61,7 +103,8 @@ namespace benchmark {
     public:
         BenchRunner(std::string name, BenchFunction func);
 
-        static void RunAll(double elapsedTimeForOne=1.0);
+        /** Run every benchmark whose name contains filter (all of them if empty) */
+        static void RunAll(Printer& printer, double elapsedTimeForOne=1.0, const std::string& filter="");
     };
 }
 
@@ -4,18 +4,58 @@
 
 #include "bench.h"
 
+#include "chainparams.h"
+#include "crypto/neoscrypt.h"
 #include "key.h"
 #include "validation.h"
 #include "util.h"
 
+#include <boost/lexical_cast.hpp>
+
+#include <iostream>
+#include <memory>
+
 int
 main(int argc, char** argv)
 {
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help")) {
+        std::cout << "Usage: bench_mogwai [options]\n\n"
+                  << "Options:\n"
+                  << "  -printer=<csv|json>  Output format for the results (default: csv)\n"
+                  << "  -filter=<name>       Only run benchmarks whose name contains <name>\n"
+                  << "  -time=<seconds>      Time spent on each benchmark (default: 1.0)\n";
+        return 0;
+    }
+
+    std::string strPrinter = GetArg("-printer", "csv");
+    std::unique_ptr<benchmark::Printer> printer;
+    if (strPrinter == "csv") {
+        printer.reset(new benchmark::CsvPrinter());
+    } else if (strPrinter == "json") {
+        printer.reset(new benchmark::JsonPrinter());
+    } else {
+        std::cerr << "Error: unknown printer '" << strPrinter << "'\n";
+        return 1;
+    }
+
+    double elapsedTimeForOne = 1.0;
+    try {
+        elapsedTimeForOne = boost::lexical_cast<double>(GetArg("-time", "1.0"));
+    } catch (const boost::bad_lexical_cast&) {
+        std::cerr << "Error: invalid -time\n";
+        return 1;
+    }
+
     ECC_Start();
+    neoscrypt_autodetect();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
+    // regtest allows the synthetic blocks to meet their proof of work cheaply
+    SelectParams(CBaseChainParams::REGTEST);
 
-    benchmark::BenchRunner::RunAll();
+    benchmark::BenchRunner::RunAll(*printer, elapsedTimeForOne, GetArg("-filter", ""));
 
     ECC_Stop();
 }
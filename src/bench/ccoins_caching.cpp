@@ -0,0 +1,43 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2017-2018 The Mogwai Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "random.h"
+#include "script/script.h"
+
+#include <vector>
+
+// Number of outputs created and flushed per iteration, about what a full block adds
+static const int BENCH_COINS_PER_FLUSH = 8000;
+
+// Updating a block worth of coins in a cache on top of a pcoinsTip-like
+// cache, then flushing it down, as ConnectBlock does
+static void CoinsCacheFlush(benchmark::State& state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache viewTip(&viewDummy);
+
+    std::vector<COutPoint> vOutpoints;
+    for (int i = 0; i < BENCH_COINS_PER_FLUSH; i++)
+        vOutpoints.push_back(COutPoint(GetRandHash(), i % 2));
+    CTxOut txout(COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0x42) << OP_EQUALVERIFY << OP_CHECKSIG);
+
+    int nHeight = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&viewTip);
+        // spend the coins of the previous iteration and create them again
+        for (const COutPoint& outpoint : vOutpoints) {
+            view.SpendCoin(outpoint);
+            view.AddCoin(outpoint, Coin(txout, nHeight, false), true);
+        }
+        view.SetBestBlock(GetRandHash());
+        assert(view.Flush());
+        nHeight++;
+    }
+}
+
+BENCHMARK(CoinsCacheFlush);
@@ -0,0 +1,140 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2017-2018 The Mogwai Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "pow.h"
+#include "random.h"
+#include "streams.h"
+#include "util.h"
+#include "validation.h"
+
+#include <boost/filesystem.hpp>
+
+// Number of transactions in the synthetic block, about 900kB in total
+static const int BENCH_BLOCK_TX = 4000;
+
+// A block of BENCH_BLOCK_TX one input, two output P2PKH style transactions
+// with a valid merkle root and proof of work for the selected chain.
+static CBlock CreateBenchBlock()
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1533055555;
+    block.nBits = UintToArith256(consensusParams.powLimit).GetCompact();
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1000 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(coinbase);
+
+    for (int i = 1; i < BENCH_BLOCK_TX; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), insecure_rand() % 4);
+        // sized like a DER signature and a compressed public key
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+        tx.vout.resize(2);
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            std::vector<unsigned char> vchKeyId(20);
+            GetRandBytes(&vchKeyId[0], vchKeyId.size());
+            tx.vout[j].nValue = (insecure_rand() % 100 + 1) * COIN;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vchKeyId << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+    }
+
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+        block.nNonce++;
+
+    return block;
+}
+
+static void DeserializeBlock(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CreateBenchBlock();
+    const std::vector<char> vchBlock(stream.begin(), stream.end());
+
+    while (state.KeepRunning()) {
+        CDataStream ss(vchBlock, SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        ss >> block;
+    }
+}
+
+static void CheckBlockFull(benchmark::State& state)
+{
+    CBlock block = CreateBenchBlock();
+
+    while (state.KeepRunning()) {
+        // CheckBlock remembers a successful check, start over every time
+        block.fChecked = false;
+        CValidationState validationState;
+        assert(CheckBlock(block, validationState, false, true));
+    }
+}
+
+// Round trip through a block file in a temporary data directory
+static void ReadBlockFromDiskBench(benchmark::State& state, bool fByIndex)
+{
+    ClearDatadirCache();
+    boost::filesystem::path pathTemp = GetTempPath() / strprintf("bench_mogwai_%lu_%i", (unsigned long)GetTime(), (int)(GetRand(100000)));
+    boost::filesystem::create_directories(pathTemp);
+    mapArgs["-datadir"] = pathTemp.string();
+
+    {
+        CBlock block = CreateBenchBlock();
+        CDiskBlockPos pos(0, 0);
+        assert(WriteBlockToDisk(block, pos, Params().MessageStart()));
+
+        // an index entry as AcceptBlock would have written it, without a parent
+        uint256 hash = block.GetHash();
+        CBlockIndex index(block);
+        index.phashBlock = &hash;
+        index.nFile = pos.nFile;
+        index.nDataPos = pos.nPos;
+        index.nStatus |= BLOCK_HAVE_DATA;
+
+        while (state.KeepRunning()) {
+            CBlock blockRead;
+            if (fByIndex)
+                assert(ReadBlockFromDisk(blockRead, &index, Params().GetConsensus()));
+            else
+                assert(ReadBlockFromDisk(blockRead, pos, Params().GetConsensus()));
+        }
+    }
+
+    ClearDatadirCache();
+    mapArgs.erase("-datadir");
+    boost::filesystem::remove_all(pathTemp);
+}
+
+static void ReadBlockFromDiskByPos(benchmark::State& state)
+{
+    ReadBlockFromDiskBench(state, false);
+}
+
+static void ReadBlockFromDiskByIndex(benchmark::State& state)
+{
+    ReadBlockFromDiskBench(state, true);
+}
+
+BENCHMARK(DeserializeBlock);
+BENCHMARK(CheckBlockFull);
+BENCHMARK(ReadBlockFromDiskByPos);
+BENCHMARK(ReadBlockFromDiskByIndex);
@@ -0,0 +1,42 @@
+// Copyright (c) 2017-2018 The Mogwai Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "governance-object.h"
+#include "random.h"
+#include "streams.h"
+
+static const int BENCH_GOVERNANCE_VOTES = 5000;
+
+// Counting the funding votes of an object voted on by every masternode, as
+// done for each object whenever the governance cache is updated
+static void GovernanceVoteCount(benchmark::State& state)
+{
+    // The votes can only be set through the disk format, so serialize an
+    // object with BENCH_GOVERNANCE_VOTES masternode votes and read it back
+    CGovernanceObject govobjEmpty(uint256(), 1, 1533055555, GetRandHash(), "");
+    CGovernanceObject::vote_m_t mapVotes;
+    for (int i = 0; i < BENCH_GOVERNANCE_VOTES; i++) {
+        vote_rec_t recVote;
+        vote_outcome_enum_t eOutcome = (i % 3 == 0) ? VOTE_OUTCOME_NO : VOTE_OUTCOME_YES;
+        recVote.mapInstances[VOTE_SIGNAL_FUNDING] = vote_instance_t(eOutcome, 1533055555, 1533055555);
+        recVote.mapInstances[VOTE_SIGNAL_VALID] = vote_instance_t(VOTE_OUTCOME_YES, 1533055555, 1533055555);
+        mapVotes[COutPoint(GetRandHash(), 0)] = recVote;
+    }
+
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    govobjEmpty.Serialize(ss, SER_NETWORK, PROTOCOL_VERSION);
+    ss << govobjEmpty.GetDeletionTime() << false << mapVotes << CGovernanceObjectVoteFile();
+
+    CGovernanceObject govobj;
+    ss >> govobj;
+    assert(govobj.GetYesCount(VOTE_SIGNAL_FUNDING) == BENCH_GOVERNANCE_VOTES - (BENCH_GOVERNANCE_VOTES + 2) / 3);
+
+    while (state.KeepRunning()) {
+        govobj.GetAbsoluteYesCount(VOTE_SIGNAL_FUNDING);
+    }
+}
+
+BENCHMARK(GovernanceVoteCount);
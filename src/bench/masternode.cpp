@@ -0,0 +1,102 @@
+// Copyright (c) 2017-2018 The Mogwai Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "masternode-sync.h"
+#include "masternodeman.h"
+#include "net.h"
+#include "random.h"
+#include "validation.h"
+
+#include <vector>
+
+static const int BENCH_MASTERNODES = 5000;
+// More blocks than CMasternodeMan caches rankings for, so cycling through
+// them never hits the rank cache
+static const int BENCH_MASTERNODE_BLOCKS = 100;
+
+/** A synced masternode list of BENCH_MASTERNODES entries on top of a synthetic chain */
+class MasternodeBenchSetup
+{
+    std::vector<uint256> vBlockHashes;
+    std::vector<CBlockIndex> vBlocks;
+
+public:
+    std::vector<COutPoint> vOutpoints;
+
+    MasternodeBenchSetup() : vBlockHashes(BENCH_MASTERNODE_BLOCKS), vBlocks(BENCH_MASTERNODE_BLOCKS)
+    {
+        for (int i = 0; i < BENCH_MASTERNODE_BLOCKS; i++) {
+            vBlockHashes[i] = GetRandHash();
+            vBlocks[i].phashBlock = &vBlockHashes[i];
+            vBlocks[i].nHeight = i;
+            vBlocks[i].pprev = i ? &vBlocks[i - 1] : NULL;
+        }
+        {
+            LOCK(cs_main);
+            chainActive.SetTip(&vBlocks.back());
+        }
+
+        for (int i = 0; i < BENCH_MASTERNODES; i++) {
+            CMasternode mn(CService(), COutPoint(GetRandHash(), 0), CPubKey(), CPubKey(), PROTOCOL_VERSION);
+            mnodeman.Add(mn);
+            vOutpoints.push_back(mn.vin.prevout);
+        }
+
+        // rankings are only available once the masternode list is synced
+        CConnman connman;
+        while (!masternodeSync.IsMasternodeListSynced())
+            masternodeSync.SwitchToNextAsset(connman);
+    }
+
+    ~MasternodeBenchSetup()
+    {
+        masternodeSync.Reset();
+        mnodeman.Clear();
+        LOCK(cs_main);
+        chainActive.SetTip(NULL);
+    }
+};
+
+// Full ranking of the list at a different block every time
+static void MasternodeRanks(benchmark::State& state)
+{
+    MasternodeBenchSetup setup;
+    CMasternodeMan::rank_pair_vec_t vecRanks;
+    int nHeight = 0;
+    while (state.KeepRunning()) {
+        assert(mnodeman.GetMasternodeRanks(vecRanks, nHeight));
+        nHeight = (nHeight + 1) % BENCH_MASTERNODE_BLOCKS;
+    }
+}
+
+// Rank of one masternode at a different block every time
+static void MasternodeRank(benchmark::State& state)
+{
+    MasternodeBenchSetup setup;
+    int nHeight = 0;
+    int nRank;
+    while (state.KeepRunning()) {
+        assert(mnodeman.GetMasternodeRank(setup.vOutpoints[nHeight], nRank, nHeight));
+        nHeight = (nHeight + 1) % BENCH_MASTERNODE_BLOCKS;
+    }
+}
+
+// Rank lookups at the same block, as done for a burst of InstantSend votes
+static void MasternodeRankCached(benchmark::State& state)
+{
+    MasternodeBenchSetup setup;
+    size_t i = 0;
+    int nRank;
+    while (state.KeepRunning()) {
+        assert(mnodeman.GetMasternodeRank(setup.vOutpoints[i], nRank));
+        i = (i + 1) % setup.vOutpoints.size();
+    }
+}
+
+BENCHMARK(MasternodeRanks);
+BENCHMARK(MasternodeRank);
+BENCHMARK(MasternodeRankCached);
@@ -0,0 +1,54 @@
+// Copyright (c) 2011-2016 The Bitcoin Core developers
+// Copyright (c) 2017-2018 The Mogwai Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "random.h"
+#include "txmempool.h"
+#include "validation.h"
+
+#include <vector>
+
+// Number of transactions added per iteration
+static const int BENCH_MEMPOOL_TX = 1000;
+// Length of the chains of unconfirmed transactions spending each other
+static const int BENCH_MEMPOOL_CHAIN = 20;
+
+// The mempool side of accepting transactions: ancestor limits and package
+// tracking on insertion, for chains of transactions spending each other.
+// Script and UTXO checks are left out, they need a full chain state.
+static void MempoolAccept(benchmark::State& state)
+{
+    std::vector<CTransaction> vTx;
+    uint256 hashPrev;
+    for (int i = 0; i < BENCH_MEMPOOL_TX; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        // start a new chain every BENCH_MEMPOOL_CHAIN transactions
+        tx.vin[0].prevout = COutPoint(i % BENCH_MEMPOOL_CHAIN ? hashPrev : GetRandHash(), 0);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = COIN - i % BENCH_MEMPOOL_CHAIN * 1000;
+        tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0x42) << OP_EQUALVERIFY << OP_CHECKSIG;
+        vTx.push_back(tx);
+        hashPrev = vTx.back().GetHash();
+    }
+
+    CTxMemPool pool(CFeeRate(1000));
+    while (state.KeepRunning()) {
+        LOCK(pool.cs);
+        for (const CTransaction& tx : vTx) {
+            CTxMemPoolEntry entry(tx, 1000, 1533055555, 0.0, 1, pool.HasNoInputsOf(tx), 0, false, 1, LockPoints());
+            CTxMemPool::setEntries setAncestors;
+            std::string errString;
+            assert(pool.CalculateMemPoolAncestors(entry, setAncestors, DEFAULT_ANCESTOR_LIMIT, DEFAULT_ANCESTOR_SIZE_LIMIT * 1000,
+                                                  DEFAULT_DESCENDANT_LIMIT, DEFAULT_DESCENDANT_SIZE_LIMIT * 1000, errString));
+            pool.addUnchecked(tx.GetHash(), entry, setAncestors, false);
+        }
+        pool.clear();
+    }
+}
+
+BENCHMARK(MempoolAccept);
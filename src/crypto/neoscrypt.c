@@ -28,6 +28,10 @@
  */
 
 
+#if defined(HAVE_CONFIG_H)
+#include "mogwai-config.h"
+#endif
+
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -2578,7 +2582,7 @@ static void neoscrypt_blkmix(uint *X, uint *Y, uint r, uint mixmode) {
  *     .....
  *     11110 = N of 2147483648;
  *   profile bits 30 to 13 are reserved */
-void neoscrypt(const uchar *password, uchar *output, uint profile) {
+static void neoscrypt_c(const uchar *password, uchar *output, uint profile) {
     const size_t stack_align = 0x40;
     uint N = 128, r = 2, dblmix = 1, mixmode = 0x14;
     uint kdf, i, j;
@@ -2715,16 +2719,29 @@ void neoscrypt(const uchar *password, uchar *output, uint profile) {
 #endif /* !(ASM) */
 
 
-#if defined(ASM) && defined(MINER_4WAY)
+#if (defined(ASM) && defined(MINER_4WAY)) || defined(USE_ASM)
+
+#if defined(USE_ASM) && !defined(ASM)
+/* SSE2 code of neoscrypt_asm.S; block copy, swap and XOR come from
+ * the portable engine */
+#define neoscrypt_xor_salsa_4way  neoscrypt_xor_salsa_4way_asm
+#define neoscrypt_xor_chacha_4way neoscrypt_xor_chacha_4way_asm
+#define neoscrypt_pack_4way       neoscrypt_pack_4way_asm
+#define neoscrypt_unpack_4way     neoscrypt_unpack_4way_asm
+#define neoscrypt_xor_4way        neoscrypt_xor_4way_asm
+#define blake2s_compress_4way     blake2s_compress_4way_asm
+#endif
 
 extern void neoscrypt_xor_salsa_4way(uint *X, uint *X0, uint *Y, uint double_rounds);
 extern void neoscrypt_xor_chacha_4way(uint *Z, uint *Z0, uint *Y, uint double_rounds);
 
 #if (1)
 
+#ifdef ASM
 extern void neoscrypt_blkcpy(void *dstp, const void *srcp, uint len);
 extern void neoscrypt_blkswp(void *blkAp, void *blkBp, uint len);
 extern void neoscrypt_blkxor(void *dstp, const void *srcp, uint len);
+#endif
 
 extern void neoscrypt_pack_4way(void *dstp, const void *srcp, uint len);
 extern void neoscrypt_unpack_4way(void *dstp, const void *srcp, uint len);
@@ -2834,11 +2851,13 @@ static void neoscrypt_xor_4way(void *dstp, const void *srcAp,
 #endif
 
 
-/* 4-way NeoScrypt(128, 2, 1) with Salsa20/20 and ChaCha20/20 */
-void neoscrypt_4way(const uchar *password, uchar *output, uchar *scratchpad) {
+/* 4-way NeoScrypt(128, 2, 1) with Salsa20/20 and ChaCha20/20
+ * of 4 independent passwords 80 bytes each */
+void neoscrypt_4way_multi(const uchar *passwords, uchar *output,
+  uchar *scratchpad) {
     const uint N = 128, r = 2, double_rounds = 10;
     uint *X, *Z, *V, *Y, *P;
-    uint i, j0, j1, j2, j3, k;
+    uint i, j0, j1, j2, j3;
 
     /* 2 * BLOCK_SIZE compacted to 128 below */;
 
@@ -2852,11 +2871,8 @@ void neoscrypt_4way(const uchar *password, uchar *output, uchar *scratchpad) {
     /* P is a set of passwords 80 bytes each */
     P = &X[4 * (N + 3) * 32 * r];
 
-    /* Load the password and increment nonces */
-    for(k = 0; k < 4; k++) {
-        neoscrypt_copy(&P[k * 20], password, 80);
-        P[(k + 1) * 20 - 1] += k;
-    }
+    /* Load the passwords */
+    neoscrypt_copy(&P[0], passwords, 4 * 80);
 
     neoscrypt_fastkdf_4way((uchar *) &P[0], (uchar *) &P[0], (uchar *) &Y[0],
       (uchar *) &scratchpad[0], 0);
@@ -2919,6 +2935,19 @@ void neoscrypt_4way(const uchar *password, uchar *output, uchar *scratchpad) {
       (uchar *) &scratchpad[0], 1);
 }
 
+/* 4-way NeoScrypt(128, 2, 1) of a password with nonces incremented */
+void neoscrypt_4way(const uchar *password, uchar *output, uchar *scratchpad) {
+    uint P[4 * 20], k;
+
+    /* Load the password and increment nonces */
+    for(k = 0; k < 4; k++) {
+        neoscrypt_copy(&P[k * 20], password, 80);
+        P[(k + 1) * 20 - 1] += k;
+    }
+
+    neoscrypt_4way_multi((uchar *) &P[0], output, scratchpad);
+}
+
 #ifdef SHA256
 /* 4-way Scrypt(1024, 1, 1) with Salsa20/8 */
 void scrypt_4way(const uchar *password, uchar *output, uchar *scratchpad) {
@@ -3251,13 +3280,239 @@ void neoscrypt_fastkdf_4way(const uchar *password, const uchar *salt,
 
 }
 
-#endif /* (ASM) && (MINER_4WAY) */
+#endif /* ((ASM) && (MINER_4WAY)) || (USE_ASM) */
 
 #ifndef ASM
+
+#ifdef USE_ASM
+
+/* Exported by neoscrypt_asm.S */
+extern void neoscrypt_asm(const uchar *password, uchar *output, uint profile);
+extern uint cpu_vec_exts_asm(void);
+
+/* Profile bit 12 switches the assembly engine from integer to SSE2 code */
+static void neoscrypt_int(const uchar *password, uchar *output, uint profile) {
+    neoscrypt_asm(password, output, profile);
+}
+
+static void neoscrypt_sse2(const uchar *password, uchar *output, uint profile) {
+    neoscrypt_asm(password, output, profile | 0x1000);
+}
+
+#endif /* USE_ASM */
+
+typedef void (*neoscrypt_engine_t)(const uchar *, uchar *, uint);
+
+/* Engine for the default profile; the portable one until
+ * neoscrypt_autodetect() finds something better */
+static neoscrypt_engine_t neoscrypt_engine = neoscrypt_c;
+
+/* Passwords hashed at once by neoscrypt_batch() */
+static uint neoscrypt_lanes = 1;
+
+/* Scratchpad of the 4-way engine, see neoscrypt_4way_multi() */
+#define NEOSCRYPT_4WAY_SCRATCHPAD_SIZE (4 * ((128 + 3) * 2 * 128 + 80))
+
+/* Input bytes 0 to 79, default profile */
+static const uchar neoscrypt_test_vector[DIGEST_SIZE] = {
+    0x72, 0x58, 0x96, 0x1A, 0xFB, 0x33, 0xFD, 0x12,
+    0xD0, 0x0C, 0xAC, 0xB8, 0xD6, 0x3F, 0x4F, 0x4F,
+    0x52, 0xBB, 0x69, 0x17, 0x04, 0x38, 0x65, 0xDD,
+    0x24, 0xA0, 0x8F, 0x57, 0x88, 0x53, 0x12, 0x2D
+};
+
+static int neoscrypt_selftest(neoscrypt_engine_t engine) {
+    uchar input[80], output[DIGEST_SIZE];
+    uint i;
+
+    for(i = 0; i < 80; i++)
+      input[i] = (uchar)i;
+
+    engine(input, output, 0);
+
+    return(!memcmp(output, neoscrypt_test_vector, DIGEST_SIZE));
+}
+
+#ifdef USE_ASM
+
+/* The lanes must agree with the portable engine for distinct passwords */
+static int neoscrypt_selftest_4way(void) {
+    const size_t align = 0x40;
+    uchar input[4 * 80], output[4 * DIGEST_SIZE], expected[DIGEST_SIZE];
+    uchar *stack, *scratchpad;
+    uint i, k;
+    int ret = 1;
+
+    stack = (uchar *) malloc(NEOSCRYPT_4WAY_SCRATCHPAD_SIZE + align);
+    if(!stack)
+      return(0);
+    scratchpad = (uchar *) (((size_t)stack & ~(align - 1)) + align);
+
+    for(k = 0; k < 4; k++)
+      for(i = 0; i < 80; i++)
+        input[k * 80 + i] = (uchar)(i ^ (k << 5));
+
+    neoscrypt_4way_multi(input, output, scratchpad);
+
+    for(k = 0; k < 4; k++) {
+        neoscrypt_c(&input[k * 80], expected, 0);
+        if(memcmp(&output[k * DIGEST_SIZE], expected, DIGEST_SIZE))
+          ret = 0;
+    }
+    if(memcmp(&output[0], neoscrypt_test_vector, DIGEST_SIZE))
+      ret = 0;
+
+    free(stack);
+
+    return(ret);
+}
+
+#endif /* USE_ASM */
+
+const char *neoscrypt_autodetect(void) {
+
+    if(!neoscrypt_selftest(neoscrypt_c))
+      return(NULL);
+
+    neoscrypt_engine = neoscrypt_c;
+    neoscrypt_lanes = 1;
+
+#ifdef USE_ASM
+    /* SSE2 is bit 5 of the extension mask, MMX is bit 0 */
+    if((cpu_vec_exts() & 0x20) && neoscrypt_selftest(neoscrypt_sse2)) {
+        neoscrypt_engine = neoscrypt_sse2;
+        if(neoscrypt_selftest_4way()) {
+            neoscrypt_lanes = 4;
+            return("sse2,4way");
+        }
+        return("sse2");
+    }
+    if((cpu_vec_exts() & 0x01) && neoscrypt_selftest(neoscrypt_int)) {
+        neoscrypt_engine = neoscrypt_int;
+        return("int");
+    }
+#endif /* USE_ASM */
+
+    return("standard");
+}
+
+void neoscrypt(const uchar *password, uchar *output, uint profile) {
+
+    /* The assembly engines support the default profile only */
+    if(!profile)
+      neoscrypt_engine(password, output, profile);
+    else
+      neoscrypt_c(password, output, profile);
+}
+
+void neoscrypt_batch(const uchar *passwords, uchar *output, uint count) {
+
+#ifdef USE_ASM
+    if((neoscrypt_lanes == 4) && (count >= 4)) {
+        const size_t align = 0x40;
+        uchar *stack, *scratchpad;
+
+        stack = (uchar *) malloc(NEOSCRYPT_4WAY_SCRATCHPAD_SIZE + align);
+        if(stack) {
+            scratchpad = (uchar *) (((size_t)stack & ~(align - 1)) + align);
+            for(; count >= 4; count -= 4) {
+                neoscrypt_4way_multi(passwords, output, scratchpad);
+                passwords += 4 * 80;
+                output += 4 * DIGEST_SIZE;
+            }
+            free(stack);
+        }
+    }
+#endif
+
+    /* The remainder one by one */
+    for(; count; count--) {
+        neoscrypt(passwords, output, 0);
+        passwords += 80;
+        output += DIGEST_SIZE;
+    }
+}
+
+/* Returns 1 if the digest taken as a 256-bit little endian number
+ * doesn't exceed the target in the same format, 0 otherwise */
+static uint neoscrypt_below_target(const uchar *hash, const uchar *target) {
+    int i;
+
+    for(i = DIGEST_SIZE - 1; i >= 0; i--) {
+        if(hash[i] != target[i])
+          return(hash[i] < target[i]);
+    }
+
+    return(1);
+}
+
+uint neoscrypt_scan(const uchar *header, uint *nonce, uint count,
+  const uchar *target, uchar *output) {
+    uchar input[4 * 80], hashes[4 * DIGEST_SIZE];
+    uchar *stack = NULL, *scratchpad = NULL;
+    uint lanes = 1, todo, n = *nonce, i, k;
+
+#ifdef USE_ASM
+    /* One scratchpad for the whole range rather than one per group */
+    if((neoscrypt_lanes == 4) && (count >= 4)) {
+        const size_t align = 0x40;
+
+        stack = (uchar *) malloc(NEOSCRYPT_4WAY_SCRATCHPAD_SIZE + align);
+        if(stack) {
+            scratchpad = (uchar *) (((size_t)stack & ~(align - 1)) + align);
+            lanes = 4;
+        }
+    }
+#endif
+
+    /* The header is laid out once per lane, only the nonces change */
+    for(k = 0; k < lanes; k++)
+      neoscrypt_copy(&input[k * 80], header, 80);
+
+    while(count) {
+        todo = (count >= lanes) ? lanes : 1;
+
+        for(k = 0; k < todo; k++) {
+            for(i = 0; i < 4; i++)
+              input[k * 80 + 76 + i] = (uchar)((n + k) >> (i * 8));
+        }
+
+#ifdef USE_ASM
+        if(todo == 4)
+          neoscrypt_4way_multi(input, hashes, scratchpad);
+        else
+#endif
+          neoscrypt(input, hashes, 0);
+
+        for(k = 0; k < todo; k++) {
+            if(neoscrypt_below_target(&hashes[k * DIGEST_SIZE], target)) {
+                *nonce = n + k;
+                neoscrypt_copy(output, &hashes[k * DIGEST_SIZE], DIGEST_SIZE);
+                if(stack)
+                  free(stack);
+                return(1);
+            }
+        }
+
+        n += todo;
+        count -= todo;
+    }
+
+    *nonce = n;
+    if(stack)
+      free(stack);
+    return(0);
+}
+
 uint cpu_vec_exts() {
 
+#ifdef USE_ASM
+    return(cpu_vec_exts_asm());
+#else
     /* No assembly, no extensions */
 
     return(0);
-}
 #endif
+}
+
+#endif /* !(ASM) */
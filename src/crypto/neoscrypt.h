@@ -13,10 +13,13 @@ void neoscrypt_copy(void *dstp, const void *srcp, unsigned int len);
 void neoscrypt_erase(void *dstp, unsigned int len);
 void neoscrypt_xor(void *dstp, const void *srcp, unsigned int len);
 
-#if defined(ASM) && defined(MINER_4WAY)
+#if (defined(ASM) && defined(MINER_4WAY)) || defined(USE_ASM)
 void neoscrypt_4way(const unsigned char *password, unsigned char *output,
   unsigned char *scratchpad);
 
+void neoscrypt_4way_multi(const unsigned char *passwords,
+  unsigned char *output, unsigned char *scratchpad);
+
 #ifdef SHA256
 void scrypt_4way(const unsigned char *password, unsigned char *output,
   unsigned char *scratchpad);
@@ -32,6 +35,23 @@ void neoscrypt_fastkdf_4way(const unsigned char *password,
 
 unsigned int cpu_vec_exts(void);
 
+/* Selects the fastest NeoScrypt engine passing the self-test and returns
+ * its name; returns NULL if the portable engine fails the self-test */
+const char *neoscrypt_autodetect(void);
+
+/* Default profile NeoScrypt of count passwords 80 bytes each stored back
+ * to back into count digests 32 bytes each; uses the multi-lane engine
+ * if neoscrypt_autodetect() has selected one */
+void neoscrypt_batch(const unsigned char *passwords, unsigned char *output,
+  unsigned int count);
+
+/* Searches up to count nonces of an 80 byte block header from *nonce on for
+ * a default profile digest not above target, both taken as 256-bit little
+ * endian numbers; returns 1 with the nonce and its digest stored if found,
+ * 0 with *nonce past the last nonce tried otherwise */
+unsigned int neoscrypt_scan(const unsigned char *header, unsigned int *nonce,
+  unsigned int count, const unsigned char *target, unsigned char *output);
+
 #if (__cplusplus)
 }
 #else
@@ -73,14 +73,44 @@ public:
     }
 };
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+static const CDBProfile dbProfiles[] = {
+    // name, compression, block size, restart interval, open files, block cache %, write buffer %
+    {"default", false, 4 * 1024, 16, 64, 50, 25},
+    // large indexes with long shared key prefixes, read in ranges
+    {"index", true, 16 * 1024, 32, 128, 50, 25},
+    // databases written in big batches, like the chainstate on a flush
+    {"writeheavy", false, 4 * 1024, 16, 64, 25, 37},
+};
+
+bool GetDBProfile(const std::string& strName, CDBProfile& profile)
+{
+    for (const CDBProfile& p : dbProfiles) {
+        if (p.strName == strName) {
+            profile = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::string> GetDBProfileNames()
+{
+    std::vector<std::string> vNames;
+    for (const CDBProfile& p : dbProfiles)
+        vNames.push_back(p.strName);
+    return vNames;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBProfile& profile)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    options.block_cache = leveldb::NewLRUCache(nCacheSize * profile.nBlockCachePercent / 100);
+    options.write_buffer_size = nCacheSize * profile.nWriteBufferPercent / 100; // up to two write buffers may be held in memory simultaneously
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.compression = profile.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.block_size = profile.nBlockSize;
+    options.block_restart_interval = profile.nBlockRestartInterval;
+    options.max_open_files = profile.nMaxOpenFiles;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -90,14 +120,18 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate,
+                       const std::string& strProfile) : path(path), nCacheSize(nCacheSize)
 {
+    if (!GetDBProfile(strProfile, profile))
+        throw dbwrapper_error("Unknown database profile " + strProfile);
+
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, profile);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -109,7 +143,7 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
             dbwrapper_private::HandleError(result);
         }
         TryCreateDirectory(path);
-        LogPrintf("Opening LevelDB in %s\n", path.string());
+        LogPrintf("Opening LevelDB in %s (profile %s)\n", path.string(), profile.strName);
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
@@ -192,7 +226,9 @@ bool CDBWrapper::IsEmpty()
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
+void CDBIterator::SeekToLast() { piter->SeekToLast(); }
 void CDBIterator::Next() { piter->Next(); }
+void CDBIterator::Prev() { piter->Prev(); }
 
 namespace dbwrapper_private {
 
@@ -28,6 +28,26 @@ public:
 
 class CDBWrapper;
 
+/** LevelDB tuning of a database, selected by name with -dbprofile */
+struct CDBProfile
+{
+    std::string strName;
+    //! Snappy compression of the table blocks, a no-op if LevelDB was built without Snappy
+    bool fCompression;
+    size_t nBlockSize;
+    //! keys between restart points, the ones in between are prefix compressed
+    int nBlockRestartInterval;
+    int nMaxOpenFiles;
+    //! shares of the cache size for the block cache and for each of the (up to two) write buffers, in percent
+    int nBlockCachePercent;
+    int nWriteBufferPercent;
+};
+
+/** Look up a built-in profile */
+bool GetDBProfile(const std::string& strName, CDBProfile& profile);
+/** Names of the built-in profiles */
+std::vector<std::string> GetDBProfileNames();
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -131,6 +151,7 @@ public:
     bool Valid();
 
     void SeekToFirst();
+    void SeekToLast();
 
     template<typename K> void Seek(const K& key) {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
@@ -141,6 +162,7 @@ public:
     }
 
     void Next();
+    void Prev();
 
     template<typename K> bool GetKey(K& key) {
         leveldb::Slice slKey = piter->key();
@@ -200,6 +222,10 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    boost::filesystem::path path;
+    size_t nCacheSize;
+    CDBProfile profile;
+
     //! a key used for optional XOR-obfuscation of the database
     std::vector<unsigned char> obfuscate_key;
 
@@ -219,10 +245,16 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] strProfile  Name of the LevelDB tuning profile, see GetDBProfile.
      */
-    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false,
+               const std::string& strProfile = "default");
     ~CDBWrapper();
 
+    const boost::filesystem::path& GetPath() const { return path; }
+    size_t GetCacheSize() const { return nCacheSize; }
+    const CDBProfile& GetProfile() const { return profile; }
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
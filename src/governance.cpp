@@ -273,6 +273,16 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, std::string& strCommand, C
     }
 }
 
+void CGovernanceManager::RegisterMessageHandlers()
+{
+    NetMsgHandler handler = [this](CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman) {
+        ProcessMessage(pfrom, strCommand, vRecv, connman);
+    };
+    RegisterNetMsgHandler(NetMsgType::MNGOVERNANCESYNC, handler);
+    RegisterNetMsgHandler(NetMsgType::MNGOVERNANCEOBJECT, handler);
+    RegisterNetMsgHandler(NetMsgType::MNGOVERNANCEOBJECTVOTE, handler);
+}
+
 void CGovernanceManager::CheckOrphanVotes(CGovernanceObject& govobj, CGovernanceException& exception, CConnman& connman)
 {
     uint256 nHash = govobj.GetHash();
@@ -303,6 +303,8 @@ public:
     void Sync(CNode* node, const uint256& nProp, const CBloomFilter& filter, CConnman& connman);
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+    /** Route the message types handled by ProcessMessage here */
+    void RegisterMessageHandlers();
 
     void DoMaintenance(CConnman& connman);
 
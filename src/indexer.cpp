@@ -0,0 +1,532 @@
+// Copyright (c) 2017-2018 The Mogwai Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "indexer.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "init.h"
+#include "txdb.h"
+#include "ui_interface.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+#include <map>
+#include <set>
+
+#include <boost/thread.hpp>
+
+CChainIndexer chainIndexer;
+
+namespace {
+
+/** Address type of the scripts the address index knows about (1 P2PKH, 2 P2SH) and their hash, 0 for others */
+int GetAddressHash(const CScript& script, uint160& hashBytes)
+{
+    if (script.IsPayToScriptHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin()+2, script.begin()+22));
+        return 2;
+    }
+    if (script.IsPayToPublicKeyHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin()+3, script.begin()+23));
+        return 1;
+    }
+    hashBytes.SetNull();
+    return 0;
+}
+
+/** What one block changes about an address, for its balance record */
+struct CBalanceChange {
+    CAmount balance;
+    CAmount received;
+    std::set<uint256> setTxids;
+
+    CBalanceChange() : balance(0), received(0) {}
+};
+typedef std::map<std::pair<int, uint160>, CBalanceChange> BalanceChangeMap;
+
+void UpdateBalances(CIndexUpdate& update, const BalanceChangeMap& mapChanges, const CBlockIndex* pindex, bool fConnect)
+{
+    CAddressBalanceUndo undo;
+    undo.nHeight = pindex->nHeight;
+    undo.hashPrevBlock = pindex->pprev->GetBlockHash();
+
+    for (BalanceChangeMap::const_iterator it = mapChanges.begin(); it != mapChanges.end(); it++) {
+        const int addressType = it->first.first;
+        const uint160& hashBytes = it->first.second;
+        const CBalanceChange& change = it->second;
+
+        CAddressBalanceValue value;
+        paddressbalancedb->ReadAddressBalance(hashBytes, addressType, value);
+        undo.vPrevious.push_back(std::make_pair(CAddressIndexIteratorKey(addressType, hashBytes), value));
+        if (fConnect) {
+            value.balance += change.balance;
+            value.received += change.received;
+            value.txCount += change.setTxids.size();
+            value.lastHeight = pindex->nHeight;
+        } else {
+            value.balance -= change.balance;
+            value.received -= change.received;
+            value.txCount -= std::min<unsigned int>(value.txCount, change.setTxids.size());
+            // the address's latest activity below this block
+            if (!value.IsNull() && !paddressindexdb->ReadAddressLastHeight(hashBytes, addressType, pindex->nHeight, value.lastHeight))
+                value.lastHeight = 0;
+        }
+        update.vAddressBalance.push_back(std::make_pair(CAddressIndexIteratorKey(addressType, hashBytes), value));
+    }
+
+    // unlike the other indexes the totals can't be replayed, a block is rolled back with
+    // its undo record if the block index doesn't know it after a crash
+    if (!fConnect)
+        undo.SetNull();
+    update.vAddressBalanceUndo.push_back(std::make_pair(pindex->GetBlockHash(), undo));
+}
+
+/** Locator of a block, which may be newer than the block index that was written to disk, requires cs_main */
+CBlockLocator GetIndexLocator(const uint256& hashBlock)
+{
+    if (hashBlock.IsNull())
+        return CBlockLocator();
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi != mapBlockIndex.end())
+        return chainActive.GetLocator(mi->second);
+    // the blocks before it were on the active chain
+    CBlockLocator locator = chainActive.GetLocator();
+    locator.vHave.insert(locator.vHave.begin(), hashBlock);
+    return locator;
+}
+
+/** Take the address totals back to a block in the block index, with the undo records of the blocks after it */
+bool RollbackAddressBalances(CIndexDB* pdb, CBlockLocator& locator)
+{
+    AssertLockHeld(cs_main);
+
+    while (!locator.IsNull() && !mapBlockIndex.count(locator.vHave[0])) {
+        const uint256 hashBlock = locator.vHave[0];
+        CAddressBalanceUndo undo;
+        if (!pdb->ReadAddressBalanceUndo(hashBlock, undo))
+            return true;
+
+        CIndexUpdate update;
+        update.vAddressBalance = undo.vPrevious;
+        update.vAddressBalanceUndo.push_back(std::make_pair(hashBlock, CAddressBalanceUndo()));
+        locator.vHave.erase(locator.vHave.begin());
+        if (locator.IsNull() || locator.vHave[0] != undo.hashPrevBlock)
+            locator.vHave.insert(locator.vHave.begin(), undo.hashPrevBlock);
+        if (!pdb->WriteUpdate(update, locator))
+            return false;
+        LogPrintf("%s: rolled back block %s at height %d\n", __func__, hashBlock.ToString(), undo.nHeight);
+    }
+    return true;
+}
+
+void AbortIndexer(const std::string& strMessage)
+{
+    strMiscWarning = strMessage;
+    LogPrintf("*** %s\n", strMessage);
+    uiInterface.ThreadSafeMessageBox(_("Error: A fatal internal error occurred, see debug.log for details"),
+                                     "", CClientUIInterface::MSG_ERROR);
+    StartShutdown();
+}
+
+} // anon namespace
+
+bool CChainIndexer::Init()
+{
+    LOCK(cs_main);
+
+    nBalanceUndoPruneHeight = -1;
+    vIndexes.clear();
+    for (const std::string& strName : GetIndexNames()) {
+        CIndexState state;
+        state.strName = strName;
+        state.fEnabled = GetIndexArg(strName);
+        state.pindexBest = NULL;
+
+        // Older versions kept the indexes in the block tree database. Their entries move to
+        // the index's own database if the index is still on, otherwise they're dropped, so
+        // none are left behind for a later start to pick up.
+        bool fLegacyEnabled = false;
+        if (pblocktree->HaveLegacyIndex(strName, fLegacyEnabled)) {
+            bool fMove = state.fEnabled && fLegacyEnabled;
+            uint256 hashLegacy;
+            if (fMove && !pblocktree->ReadLegacyIndexBestBlock(strName, hashLegacy)) {
+                // Even older versions kept their indexes in sync with the tip while connecting
+                // blocks. That only holds now, so it's recorded for a move that gets interrupted.
+                if (chainActive.Tip())
+                    hashLegacy = chainActive.Tip()->GetBlockHash();
+                if (!pblocktree->WriteLegacyIndexBestBlock(strName, hashLegacy))
+                    return error("%s: failed to write the best block of %s", __func__, strName);
+            }
+            // an interrupted drop must not be taken for an index in sync later on
+            if (!fMove && fLegacyEnabled && !pblocktree->WriteFlag(strName, false))
+                return error("%s: failed to write the flag of %s", __func__, strName);
+            LogPrintf("%s: %s %s out of the block tree database\n", __func__, fMove ? "moving" : "dropping", strName);
+            uiInterface.InitMessage(strprintf(_("Moving %s to its own database..."), strName));
+            if (!pblocktree->MoveLegacyIndex(strName, fMove ? GetIndexDB(strName) : NULL, GetIndexLocator(hashLegacy)))
+                return ShutdownRequested() ? false : error("%s: failed to move %s", __func__, strName);
+        }
+
+        if (state.fEnabled) {
+            CIndexDB* pdb = GetIndexDB(strName);
+            CBlockLocator locator;
+            if (pdb->ReadBestBlock(locator) && !locator.IsNull()) {
+                if (strName == "addressbalance" && !RollbackAddressBalances(pdb, locator))
+                    return error("%s: failed to roll back %s", __func__, strName);
+                BlockMap::iterator mi = mapBlockIndex.find(locator.vHave[0]);
+                if (mi != mapBlockIndex.end()) {
+                    state.pindexBest = mi->second;
+                } else if (strName == "addressbalance") {
+                    LogPrintf("%s: %s can't be rolled back to a known block, rebuilding it\n", __func__, strName);
+                    WipeIndexDB(strName);
+                } else {
+                    // After a crash an index is usually ahead of the block index that was written
+                    // to disk. It resumes at the last block both know and adds the blocks after
+                    // that again, which overwrites their entries.
+                    state.pindexBest = FindForkInGlobalIndex(chainActive, locator);
+                    LogPrintf("%s: %s is synced to unknown block %s, resuming at the last known one\n", __func__, strName, locator.vHave[0].ToString());
+                }
+            } else if (!pdb->IsEmpty()) {
+                LogPrintf("%s: %s has no best block, rebuilding it\n", __func__, strName);
+                WipeIndexDB(strName);
+            }
+            LogPrintf("%s: %s synced to height %d\n", __func__, state.strName, state.pindexBest ? state.pindexBest->nHeight : -1);
+        }
+        vIndexes.push_back(state);
+    }
+
+    return true;
+}
+
+const CBlockIndex* CChainIndexer::GetBestBlock(const std::string& strName)
+{
+    LOCK(cs_main);
+    for (const CIndexState& state : vIndexes) {
+        if (state.strName == strName)
+            return state.fEnabled ? state.pindexBest : NULL;
+    }
+    return NULL;
+}
+
+void CChainIndexer::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fTipChanged = true;
+    }
+    condTip.notify_one();
+}
+
+const CBlockIndex* CChainIndexer::FindNextBlock(bool& fConnect, std::vector<size_t>& vUpdate) const
+{
+    AssertLockHeld(cs_main);
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (pindexTip == NULL)
+        return NULL;
+
+    // Blocks that were disconnected from the active chain go first, highest first. An
+    // index ahead of the tip (as during -reindex-chainstate) just waits for the chain.
+    const CBlockIndex* pindex = NULL;
+    for (const CIndexState& state : vIndexes) {
+        if (!state.fEnabled || state.pindexBest == NULL || chainActive.Contains(state.pindexBest))
+            continue;
+        if (state.pindexBest->GetAncestor(pindexTip->nHeight) == pindexTip)
+            continue;
+        if (pindex == NULL || state.pindexBest->nHeight > pindex->nHeight)
+            pindex = state.pindexBest;
+    }
+    fConnect = pindex == NULL;
+
+    if (fConnect) {
+        // then the indexes closest to the tip move one block along the active chain,
+        // so indexes that are being built don't hold up the ones that are in sync
+        int nHeight = -2;
+        for (const CIndexState& state : vIndexes) {
+            if (!state.fEnabled)
+                continue;
+            if (state.pindexBest == NULL)
+                nHeight = std::max(nHeight, -1);
+            else if (state.pindexBest != pindexTip && chainActive.Contains(state.pindexBest))
+                nHeight = std::max(nHeight, state.pindexBest->nHeight);
+        }
+        if (nHeight == -2)
+            return NULL;
+        pindex = chainActive[nHeight + 1];
+    }
+
+    const CBlockIndex* pindexFrom = fConnect ? pindex->pprev : pindex;
+    for (size_t i = 0; i < vIndexes.size(); i++) {
+        if (vIndexes[i].fEnabled && vIndexes[i].pindexBest == pindexFrom)
+            vUpdate.push_back(i);
+    }
+    return pindex;
+}
+
+void CChainIndexer::ConnectBlock(CIndexUpdate& update, const std::string& strName,
+                                 const CBlock& block, const CBlockUndo& blockundo,
+                                 const CBlockIndex* pindex, const CDiskBlockPos& blockPos)
+{
+    bool fTx = strName == "txindex";
+    bool fAddress = strName == "addressindex";
+    bool fBalance = strName == "addressbalance";
+    bool fSpent = strName == "spentindex";
+    BalanceChangeMap mapBalance;
+
+    CDiskTxPos pos(blockPos, GetSizeOfCompactSize(block.vtx.size()));
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+
+        if (fTx) {
+            update.vTxIndex.push_back(std::make_pair(txhash, pos));
+            pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        }
+
+        if (i > 0 && (fAddress || fBalance || fSpent)) {
+            const CTxUndo& txundo = blockundo.vtxundo[i-1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CTxIn& input = tx.vin[j];
+                const CTxOut& prevout = txundo.vprevout[j].out;
+                uint160 hashBytes;
+                int addressType = GetAddressHash(prevout.scriptPubKey, hashBytes);
+
+                if (fAddress && addressType > 0) {
+                    // record spending activity
+                    update.vAddressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
+
+                    // remove address from unspent index
+                    update.vAddressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+                }
+
+                if (fBalance && addressType > 0) {
+                    CBalanceChange& change = mapBalance[std::make_pair(addressType, hashBytes)];
+                    change.balance -= prevout.nValue;
+                    change.setTxids.insert(txhash);
+                }
+
+                if (fSpent) {
+                    // add the spent index to determine the txid and input that spent an output
+                    // and to find the amount and address from an input
+                    update.vSpentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, addressType, hashBytes)));
+                }
+            }
+        }
+
+        if (fAddress || fBalance) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                uint160 hashBytes;
+                int addressType = GetAddressHash(out.scriptPubKey, hashBytes);
+                if (addressType == 0)
+                    continue;
+
+                if (fAddress) {
+                    // record receiving activity
+                    update.vAddressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
+
+                    // record unspent output
+                    update.vAddressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
+                }
+
+                if (fBalance) {
+                    CBalanceChange& change = mapBalance[std::make_pair(addressType, hashBytes)];
+                    change.balance += out.nValue;
+                    change.received += out.nValue;
+                    change.setTxids.insert(txhash);
+                }
+            }
+        }
+    }
+
+    if (fBalance)
+        UpdateBalances(update, mapBalance, pindex, true);
+
+    if (strName == "timestampindex")
+        update.vTimestampIndex.push_back(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash()));
+}
+
+void CChainIndexer::DisconnectBlock(CIndexUpdate& update, const std::string& strName,
+                                    const CBlock& block, const CBlockUndo& blockundo,
+                                    const CBlockIndex* pindex)
+{
+    // the transaction index keeps its entries, they're overwritten if the transactions confirm again
+    bool fAddress = strName == "addressindex";
+    bool fBalance = strName == "addressbalance";
+    bool fSpent = strName == "spentindex";
+    BalanceChangeMap mapBalance;
+
+    // undo transactions in reverse order
+    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+        const CTransaction& tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+
+        if (fAddress || fBalance) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                const CTxOut& out = tx.vout[k];
+                uint160 hashBytes;
+                int addressType = GetAddressHash(out.scriptPubKey, hashBytes);
+                if (addressType == 0)
+                    continue;
+
+                if (fAddress) {
+                    // undo receiving activity
+                    update.vAddressIndexErase.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
+
+                    // undo unspent index
+                    update.vAddressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k), CAddressUnspentValue()));
+                }
+
+                if (fBalance) {
+                    CBalanceChange& change = mapBalance[std::make_pair(addressType, hashBytes)];
+                    change.balance += out.nValue;
+                    change.received += out.nValue;
+                    change.setTxids.insert(txhash);
+                }
+            }
+        }
+
+        if (i > 0 && (fAddress || fBalance || fSpent)) {
+            const CTxUndo& txundo = blockundo.vtxundo[i-1];
+            for (unsigned int j = tx.vin.size(); j-- > 0;) {
+                const CTxIn& input = tx.vin[j];
+                const Coin& coin = txundo.vprevout[j];
+                uint160 hashBytes;
+                int addressType = GetAddressHash(coin.out.scriptPubKey, hashBytes);
+
+                if (fSpent) {
+                    // undo and delete the spent index
+                    update.vSpentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
+                }
+
+                if (fAddress && addressType > 0) {
+                    // undo spending activity
+                    update.vAddressIndexErase.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), coin.out.nValue * -1));
+
+                    // restore unspent index
+                    update.vAddressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight)));
+                }
+
+                if (fBalance && addressType > 0) {
+                    CBalanceChange& change = mapBalance[std::make_pair(addressType, hashBytes)];
+                    change.balance -= coin.out.nValue;
+                    change.setTxids.insert(txhash);
+                }
+            }
+        }
+    }
+
+    if (fBalance)
+        UpdateBalances(update, mapBalance, pindex, false);
+
+    if (strName == "timestampindex")
+        update.vTimestampIndexErase.push_back(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash()));
+}
+
+void CChainIndexer::ThreadIndexer()
+{
+    RenameThread("mogwai-indexer");
+
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        bool fConnect = true;
+        std::vector<size_t> vUpdate;
+        const CBlockIndex* pindex = NULL;
+        CDiskBlockPos blockPos;
+        CDiskBlockPos undoPos;
+        CBlockLocator locator;
+        // blocks up to the chainstate on disk are in the block index on disk as well
+        int nFlushedHeight = -1;
+        {
+            LOCK(cs_main);
+            pindex = FindNextBlock(fConnect, vUpdate);
+            if (pindex != NULL) {
+                if (!(pindex->nStatus & BLOCK_HAVE_DATA) || (pindex->pprev != NULL && !(pindex->nStatus & BLOCK_HAVE_UNDO))) {
+                    AbortIndexer(strprintf("%s: data of block %s is missing, restart with -reindex to rebuild the indexes", __func__, pindex->GetBlockHash().ToString()));
+                    return;
+                }
+                blockPos = pindex->GetBlockPos();
+                undoPos = pindex->GetUndoPos();
+                locator = chainActive.GetLocator(fConnect ? pindex : pindex->pprev);
+                BlockMap::iterator mi = mapBlockIndex.find(pcoinsdbview->GetBestBlock());
+                if (mi != mapBlockIndex.end())
+                    nFlushedHeight = mi->second->nHeight;
+            }
+        }
+
+        if (pindex == NULL) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fTipChanged)
+                condTip.wait(lock);
+            fTipChanged = false;
+            continue;
+        }
+
+        // every index gets a batch of its own
+        std::map<std::string, CIndexUpdate> mapUpdates;
+        for (size_t i : vUpdate)
+            mapUpdates[vIndexes[i].strName];
+
+        // the genesis block's outputs aren't spendable and never were indexed
+        if (pindex->pprev != NULL) {
+            CBlock block;
+            CBlockUndo blockundo;
+            if (!ReadBlockFromDisk(block, blockPos, consensusParams) || block.GetHash() != pindex->GetBlockHash()) {
+                AbortIndexer(strprintf("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString()));
+                return;
+            }
+            if (!UndoReadFromDisk(blockundo, undoPos, pindex->pprev->GetBlockHash()) || blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+                AbortIndexer(strprintf("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString()));
+                return;
+            }
+            for (unsigned int i = 1; i < block.vtx.size(); i++) {
+                if (blockundo.vtxundo[i-1].vprevout.size() != block.vtx[i].vin.size()) {
+                    AbortIndexer(strprintf("%s: transaction and undo data of block %s inconsistent", __func__, pindex->GetBlockHash().ToString()));
+                    return;
+                }
+            }
+
+            for (std::map<std::string, CIndexUpdate>::iterator it = mapUpdates.begin(); it != mapUpdates.end(); it++) {
+                if (fConnect)
+                    ConnectBlock(it->second, it->first, block, blockundo, pindex, blockPos);
+                else
+                    DisconnectBlock(it->second, it->first, block, blockundo, pindex);
+            }
+        }
+
+        std::map<std::string, CIndexUpdate>::iterator itBalance = mapUpdates.find("addressbalance");
+        if (itBalance != mapUpdates.end()) {
+            // the block index on disk has the blocks up to nFlushedHeight, they don't need undo records
+            if (fConnect && pindex->nHeight <= nFlushedHeight)
+                itBalance->second.vAddressBalanceUndo.clear();
+            if (nFlushedHeight > nBalanceUndoPruneHeight)
+                itBalance->second.nAddressBalanceUndoPruneHeight = nFlushedHeight;
+        }
+
+        const CBlockIndex* pindexBest = fConnect ? pindex : pindex->pprev;
+        for (std::map<std::string, CIndexUpdate>::const_iterator it = mapUpdates.begin(); it != mapUpdates.end(); it++) {
+            if (!GetIndexDB(it->first)->WriteUpdate(it->second, locator)) {
+                AbortIndexer(strprintf("Failed to write %s", it->first));
+                return;
+            }
+        }
+        if (itBalance != mapUpdates.end())
+            nBalanceUndoPruneHeight = std::max(nBalanceUndoPruneHeight, nFlushedHeight);
+
+        {
+            LOCK(cs_main);
+            for (size_t i : vUpdate)
+                vIndexes[i].pindexBest = pindexBest;
+        }
+
+        if (!fConnect)
+            LogPrint("index", "%s: removed block %s at height %d\n", __func__, pindex->GetBlockHash().ToString(), pindex->nHeight);
+        else if (pindex->nHeight % 10000 == 0)
+            LogPrintf("%s: indexed up to height %d\n", __func__, pindex->nHeight);
+    }
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2017-2018 The Mogwai Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef INDEXER_H
+#define INDEXER_H
+
+#include "validationinterface.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+class CChainIndexer;
+struct CDiskBlockPos;
+struct CIndexUpdate;
+
+extern CChainIndexer chainIndexer;
+
+/**
+ * Maintains the optional indexes (-txindex, -addressindex, -spentindex and
+ * -timestampindex) on a thread of its own, so connecting a block only has to
+ * update the UTXO set. Every index has a database of its own under indexes/,
+ * keeps a locator of the last block it contains and follows the active chain
+ * from there, one block and one database batch at a time. An index that was just
+ * turned on is built this way as well, without reindexing. Lookups may
+ * briefly miss the newest blocks.
+ */
+class CChainIndexer : public CValidationInterface
+{
+private:
+    struct CIndexState {
+        std::string strName;
+        bool fEnabled;
+        // last block whose changes are in the index, guarded by cs_main
+        const CBlockIndex* pindexBest;
+    };
+
+    std::vector<CIndexState> vIndexes;
+
+    boost::mutex mutex;
+    boost::condition_variable condTip;
+    bool fTipChanged;
+
+    // address balance undo records are erased up to this height
+    int nBalanceUndoPruneHeight;
+
+    /** Pick the next block to add to (or remove from) the indexes that are behind, requires cs_main */
+    const CBlockIndex* FindNextBlock(bool& fConnect, std::vector<size_t>& vUpdate) const;
+
+    static void ConnectBlock(CIndexUpdate& update, const std::string& strName,
+                             const CBlock& block, const CBlockUndo& blockundo,
+                             const CBlockIndex* pindex, const CDiskBlockPos& blockPos);
+    static void DisconnectBlock(CIndexUpdate& update, const std::string& strName,
+                                const CBlock& block, const CBlockUndo& blockundo,
+                                const CBlockIndex* pindex);
+
+protected:
+    // CValidationInterface
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+
+public:
+    CChainIndexer() : fTipChanged(false), nBalanceUndoPruneHeight(-1) {}
+
+    /** Load which block every index is synced to, call once the block index is loaded */
+    bool Init();
+    /** Last block in an index, NULL if the index is off or empty */
+    const CBlockIndex* GetBestBlock(const std::string& strName);
+
+    void ThreadIndexer();
+};
+
+#endif
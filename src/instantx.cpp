@@ -11,6 +11,7 @@
 #include "masternodeman.h"
 #include "messagesigner.h"
 #include "net.h"
+#include "net_processing.h"
 #include "protocol.h"
 #include "spork.h"
 #include "sync.h"
@@ -85,6 +86,14 @@ void CInstantSend::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataSt
     }
 }
 
+void CInstantSend::RegisterMessageHandlers()
+{
+    NetMsgHandler handler = [this](CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman) {
+        ProcessMessage(pfrom, strCommand, vRecv, connman);
+    };
+    RegisterNetMsgHandler(NetMsgType::TXLOCKVOTE, handler);
+}
+
 bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CConnman& connman)
 {
     LOCK2(cs_main, cs_instantsend);
@@ -85,6 +85,8 @@ public:
     CCriticalSection cs_instantsend;
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+    /** Route the message types handled by ProcessMessage here */
+    void RegisterMessageHandlers();
 
     bool ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CConnman& connman);
     void Vote(const uint256& txHash, CConnman& connman);
@@ -9,6 +9,7 @@
 #include "masternode-sync.h"
 #include "masternodeman.h"
 #include "messagesigner.h"
+#include "net_processing.h"
 #include "netfulfilledman.h"
 #include "spork.h"
 #include "util.h"
@@ -416,6 +417,15 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, std::string& strCommand,
     }
 }
 
+void CMasternodePayments::RegisterMessageHandlers()
+{
+    NetMsgHandler handler = [this](CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman) {
+        ProcessMessage(pfrom, strCommand, vRecv, connman);
+    };
+    RegisterNetMsgHandler(NetMsgType::MASTERNODEPAYMENTSYNC, handler);
+    RegisterNetMsgHandler(NetMsgType::MASTERNODEPAYMENTVOTE, handler);
+}
+
 bool CMasternodePaymentVote::Sign()
 {
     std::string strError;
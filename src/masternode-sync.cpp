@@ -11,6 +11,7 @@
 #include "masternode-payments.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
+#include "net_processing.h"
 #include "netfulfilledman.h"
 #include "spork.h"
 #include "ui_interface.h"
@@ -136,6 +137,14 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
     }
 }
 
+void CMasternodeSync::RegisterMessageHandlers()
+{
+    NetMsgHandler handler = [this](CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman) {
+        ProcessMessage(pfrom, strCommand, vRecv);
+    };
+    RegisterNetMsgHandler(NetMsgType::SYNCSTATUSCOUNT, handler);
+}
+
 void CMasternodeSync::ClearFulfilledRequests(CConnman& connman)
 {
     // TODO: Find out whether we can just use LOCK instead of:
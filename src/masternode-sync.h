@@ -74,6 +74,8 @@ public:
     void SwitchToNextAsset(CConnman& connman);
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+    /** Route the message types handled by ProcessMessage here */
+    void RegisterMessageHandlers();
     void ProcessTick(CConnman& connman);
 
     void AcceptedBlockHeader(const CBlockIndex *pindexNew);
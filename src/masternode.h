@@ -157,6 +157,8 @@ public:
     CMasternodePing lastPing{};
     std::vector<unsigned char> vchSig{};
 
+    // part of the score, set by CheckOutpoint on the broadcast that adds the
+    // masternode and not touched by later broadcasts (see CMasternodeMan::mapRankCache)
     uint256 nCollateralMinConfBlockHash{};
     int nBlockLastPaid{};
     int nPoSeBanScore{};
@@ -270,7 +272,8 @@ public:
 
     int GetLastPaidTime() { return nTimeLastPaid; }
     int GetLastPaidBlock() { return nBlockLastPaid; }
-    void UpdateLastPaid(const CBlockIndex *pindex, int nMaxBlocksToScanBack);
+    /// Update last paid block from the coinbase payments collected by CMasternodeMan::UpdateLastPaid
+    void UpdateLastPaid(const CBlockIndex *pindex, const std::map<CScript, std::set<int> >& mapPayeeHeights);
 
     // KEEP TRACK OF EACH GOVERNANCE ITEM INCASE THIS NODE GOES OFFLINE, SO WE CAN RECALC THEIR STATUS
     void AddGovernanceVote(uint256 nGovernanceObjectHash);
@@ -10,6 +10,7 @@
 #include "masternode-sync.h"
 #include "masternodeman.h"
 #include "messagesigner.h"
+#include "net_processing.h"
 #include "netfulfilledman.h"
 #ifdef ENABLE_WALLET
 #include "privatesend-client.h"
@@ -64,6 +65,11 @@ CMasternodeMan::CMasternodeMan()
   fMasternodesRemoved(false),
   vecDirtyGovernanceObjectHashes(),
   nLastWatchdogVoteTime(0),
+  mapRankCache(),
+  listRankCacheKeys(),
+  paidPayees(),
+  pindexLastPaidScan(NULL),
+  nLastPaidScanFirstHeight(0),
   mapSeenMasternodeBroadcast(),
   mapSeenMasternodePing(),
   nDsqCount(0)
@@ -77,6 +83,7 @@ bool CMasternodeMan::Add(CMasternode &mn)
 
     LogPrint("masternode", "CMasternodeMan::Add -- Adding new Masternode: addr=%s, %i now\n", mn.addr.ToString(), size() + 1);
     mapMasternodes[mn.vin.prevout] = mn;
+    ClearRankCache();
     fMasternodesAdded = true;
     return true;
 }
@@ -191,6 +198,7 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
                 // and finally remove it from the list
                 it->second.FlagGovernanceItemsAsDirty();
                 mapMasternodes.erase(it++);
+                ClearRankCache();
                 fMasternodesRemoved = true;
             } else {
                 bool fAsk = (nAskForMnbRecovery > 0) &&
@@ -346,11 +354,15 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     mapMasternodes.clear();
+    ClearRankCache();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
+    paidPayees.Clear();
+    pindexLastPaidScan = NULL;
+    nLastPaidScanFirstHeight = 0;
     nDsqCount = 0;
     nLastWatchdogVoteTime = 0;
 }
@@ -483,6 +495,16 @@ bool CMasternodeMan::Has(const COutPoint& outpoint)
     return mapMasternodes.find(outpoint) != mapMasternodes.end();
 }
 
+bool CMasternodeMan::Has(const CService& addr)
+{
+    LOCK(cs);
+    for (auto& mnpair : mapMasternodes) {
+        if (mnpair.second.addr == addr && mnpair.second.IsEnabled())
+            return true;
+    }
+    return false;
+}
+
 //
 // Deterministically select the oldest/best masternode to pay on the network
 //
@@ -698,20 +720,16 @@ bool CMasternodeMan::GetMasternodeRank(const COutPoint& outpoint, int& nRankRet,
 
     LOCK(cs);
 
-    score_pair_vec_t vecMasternodeScores;
-    if (!GetMasternodeScores(nBlockHash, vecMasternodeScores, nMinProtocol))
+    const rank_cache_t* pRanks = GetRankCache(nBlockHash, nMinProtocol);
+    if (!pRanks)
         return false;
 
-    int nRank = 0;
-    for (auto& scorePair : vecMasternodeScores) {
-        nRank++;
-        if(scorePair.second->vin.prevout == outpoint) {
-            nRankRet = nRank;
-            return true;
-        }
-    }
+    std::map<COutPoint, int>::const_iterator it = pRanks->mapRanks.find(outpoint);
+    if (it == pRanks->mapRanks.end())
+        return false;
 
-    return false;
+    nRankRet = it->second;
+    return true;
 }
 
 bool CMasternodeMan::GetMasternodeRanks(CMasternodeMan::rank_pair_vec_t& vecMasternodeRanksRet, int nBlockHeight, int nMinProtocol)
@@ -730,17 +748,55 @@ bool CMasternodeMan::GetMasternodeRanks(CMasternodeMan::rank_pair_vec_t& vecMast
 
     LOCK(cs);
 
+    const rank_cache_t* pRanks = GetRankCache(nBlockHash, nMinProtocol);
+    if (!pRanks)
+        return false;
+
+    int nRank = 0;
+    for (const auto& outpoint : pRanks->vecOutpoints) {
+        nRank++;
+        vecMasternodeRanksRet.push_back(std::make_pair(nRank, mapMasternodes[outpoint]));
+    }
+
+    return true;
+}
+
+const CMasternodeMan::rank_cache_t* CMasternodeMan::GetRankCache(const uint256& nBlockHash, int nMinProtocol)
+{
+    AssertLockHeld(cs);
+
+    rank_cache_key_t key = std::make_pair(nBlockHash, nMinProtocol);
+    std::map<rank_cache_key_t, rank_cache_t>::const_iterator it = mapRankCache.find(key);
+    if (it != mapRankCache.end())
+        return &it->second;
+
     score_pair_vec_t vecMasternodeScores;
     if (!GetMasternodeScores(nBlockHash, vecMasternodeScores, nMinProtocol))
-        return false;
+        return NULL;
 
+    // keep only the most recent rankings, the oldest one goes first
+    if ((int)listRankCacheKeys.size() >= MAX_RANK_CACHE_ENTRIES) {
+        mapRankCache.erase(listRankCacheKeys.front());
+        listRankCacheKeys.pop_front();
+    }
+
+    rank_cache_t& ranks = mapRankCache[key];
+    listRankCacheKeys.push_back(key);
+    ranks.vecOutpoints.reserve(vecMasternodeScores.size());
     int nRank = 0;
     for (auto& scorePair : vecMasternodeScores) {
         nRank++;
-        vecMasternodeRanksRet.push_back(std::make_pair(nRank, *scorePair.second));
+        ranks.vecOutpoints.push_back(scorePair.second->vin.prevout);
+        ranks.mapRanks[scorePair.second->vin.prevout] = nRank;
     }
 
-    return true;
+    return &ranks;
+}
+
+void CMasternodeMan::ClearRankCache()
+{
+    mapRankCache.clear();
+    listRankCacheKeys.clear();
 }
 
 
@@ -951,6 +1007,17 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
     }
 }
 
+void CMasternodeMan::RegisterMessageHandlers()
+{
+    NetMsgHandler handler = [this](CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman) {
+        ProcessMessage(pfrom, strCommand, vRecv, connman);
+    };
+    RegisterNetMsgHandler(NetMsgType::MNANNOUNCE, handler);
+    RegisterNetMsgHandler(NetMsgType::MNPING, handler);
+    RegisterNetMsgHandler(NetMsgType::DSEG, handler);
+    RegisterNetMsgHandler(NetMsgType::MNVERIFY, handler);
+}
+
 // Verification of masternodes via unique direct requests.
 
 void CMasternodeMan::DoFullVerificationStep(CConnman& connman)
@@ -1392,6 +1459,8 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb, CConnman& co
         }
     } else {
         CMasternodeBroadcast mnbOld = mapSeenMasternodeBroadcast[CMasternodeBroadcast(*pmn).GetHash()].second;
+        // the broadcast may carry a new protocol version
+        ClearRankCache();
         if(pmn->UpdateFromNewBroadcast(mnb, connman)) {
             masternodeSync.BumpAssetLastTime("CMasternodeMan::UpdateMasternodeList - seen");
             mapSeenMasternodeBroadcast.erase(mnbOld.GetHash());
@@ -1454,6 +1523,8 @@ bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBr
         CMasternode* pmn = Find(mnb.vin.prevout);
         if(pmn) {
             CMasternodeBroadcast mnbOld = mapSeenMasternodeBroadcast[CMasternodeBroadcast(*pmn).GetHash()].second;
+            // the broadcast may carry a new protocol version
+            ClearRankCache();
             if(!mnb.Update(pmn, nDos, connman)) {
                 LogPrint("masternode", "CMasternodeMan::CheckMnbAndUpdateMasternodeList -- Update() failed, masternode=%s\n", mnb.vin.prevout.ToStringShort());
                 return false;
@@ -1492,25 +1563,82 @@ bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBr
     return true;
 }
 
+void CMasternodePaidPayees::AddBlock(int nHeight, const CTransaction& txCoinbase, CAmount nMasternodePayment)
+{
+    for (const auto& txout : txCoinbase.vout) {
+        if(txout.nValue == nMasternodePayment) {
+            mapPayees[nHeight].insert(txout.scriptPubKey);
+            mapHeights[txout.scriptPubKey].insert(nHeight);
+        }
+    }
+}
+
+void CMasternodePaidPayees::KeepRange(int nKeepFrom, int nKeepTo)
+{
+    std::map<int, std::set<CScript> >::iterator it = mapPayees.begin();
+    while(it != mapPayees.end()) {
+        if(it->first >= nKeepFrom && it->first < nKeepTo) {
+            ++it;
+            continue;
+        }
+        for (const auto& payee : it->second) {
+            std::map<CScript, std::set<int> >::iterator itPayee = mapHeights.find(payee);
+            if(itPayee == mapHeights.end()) continue;
+            itPayee->second.erase(it->first);
+            if(itPayee->second.empty()) mapHeights.erase(itPayee);
+        }
+        mapPayees.erase(it++);
+    }
+}
+
+void CMasternodePaidPayees::Clear()
+{
+    mapPayees.clear();
+    mapHeights.clear();
+}
+
 void CMasternodeMan::UpdateLastPaid(const CBlockIndex* pindex)
 {
     LOCK(cs);
 
-    if(fLiteMode || !masternodeSync.IsWinnersListSynced() || mapMasternodes.empty()) return;
+    if(fLiteMode || !masternodeSync.IsWinnersListSynced() || mapMasternodes.empty() || !pindex) return;
+
+    // Scan the whole payments storage window on first run, after that only the
+    // blocks connected since the previous call, so every coinbase is read once.
+    // The window grows with the masternode count, when its start moves down
+    // the blocks below the old start were never scanned, so start over.
+    int nFirstHeight = std::max(0, pindex->nHeight - mnpayments.GetStorageLimit() + 1);
+    int nScanFrom = nFirstHeight;
+    if(pindexLastPaidScan && nFirstHeight >= nLastPaidScanFirstHeight) {
+        // step back to the fork point if the chain was reorganized in between
+        const CBlockIndex* pindexFork = pindexLastPaidScan;
+        while(pindexFork && pindex->GetAncestor(pindexFork->nHeight) != pindexFork) {
+            pindexFork = pindexFork->pprev;
+        }
+        if(pindexFork) {
+            nScanFrom = std::max(nScanFrom, pindexFork->nHeight + 1);
+        }
+    }
 
-    static bool IsFirstRun = true;
-    // Do full scan on first run or if we are not a masternode
-    // (MNs should update this info on every block, so limited scan should be enough for them)
-    int nMaxBlocksToScanBack = (IsFirstRun || !fMasterNode) ? mnpayments.GetStorageLimit() : LAST_PAID_SCAN_BLOCKS;
+    // forget blocks which left the window or were disconnected
+    paidPayees.KeepRange(nFirstHeight, nScanFrom);
 
-    // LogPrint("mnpayments", "CMasternodeMan::UpdateLastPaid -- nHeight=%d, nMaxBlocksToScanBack=%d, IsFirstRun=%s\n",
-    //                         nCachedBlockHeight, nMaxBlocksToScanBack, IsFirstRun ? "true" : "false");
+    LogPrint("mnpayments", "CMasternodeMan::UpdateLastPaid -- nHeight=%d, scanning from %d\n", pindex->nHeight, nScanFrom);
 
-    for (auto& mnpair: mapMasternodes) {
-        mnpair.second.UpdateLastPaid(pindex, nMaxBlocksToScanBack);
+    for (int nHeight = nScanFrom; nHeight <= pindex->nHeight; nHeight++) {
+        const CBlockIndex* pindexScan = pindex->GetAncestor(nHeight);
+        CBlock block;
+        if(!ReadBlockFromDisk(block, pindexScan, Params().GetConsensus())) // shouldn't really happen
+            continue;
+
+        paidPayees.AddBlock(nHeight, block.vtx[0], GetMasternodePayment(nHeight, block.vtx[0].GetValueOut()));
     }
+    pindexLastPaidScan = pindex;
+    nLastPaidScanFirstHeight = nFirstHeight;
 
-    IsFirstRun = false;
+    for (auto& mnpair: mapMasternodes) {
+        mnpair.second.UpdateLastPaid(pindex, paidPayees.GetPayeeHeights());
+    }
 }
 
 void CMasternodeMan::UpdateWatchdogVoteTime(const COutPoint& outpoint, uint64_t nVoteTime)
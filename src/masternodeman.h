@@ -16,6 +16,24 @@ class CConnman;
 
 extern CMasternodeMan mnodeman;
 
+/// Coinbase outputs paying the masternode amount, for the blocks in the payments storage window
+class CMasternodePaidPayees
+{
+private:
+    /// Payees by height, a coinbase may pay the same script more than once
+    std::map<int, std::set<CScript> > mapPayees;
+    /// Same as above, indexed by payee
+    std::map<CScript, std::set<int> > mapHeights;
+
+public:
+    void AddBlock(int nHeight, const CTransaction& txCoinbase, CAmount nMasternodePayment);
+    /// Forget the blocks outside [nKeepFrom, nKeepTo)
+    void KeepRange(int nKeepFrom, int nKeepTo);
+    void Clear();
+
+    const std::map<CScript, std::set<int> >& GetPayeeHeights() const { return mapHeights; }
+};
+
 class CMasternodeMan
 {
 public:
@@ -29,8 +47,6 @@ private:
 
     static const int DSEG_UPDATE_SECONDS        = 3 * 60 * 60;
 
-    static const int LAST_PAID_SCAN_BLOCKS      = 100;
-
     static const int MIN_POSE_PROTO_VERSION     = 70203;
     static const int MAX_POSE_CONNECTIONS       = 10;
     static const int MAX_POSE_RANK              = 10;
@@ -42,6 +58,8 @@ private:
     static const int MNB_RECOVERY_WAIT_SECONDS      = 60;
     static const int MNB_RECOVERY_RETRY_SECONDS     = 3 * 60 * 60;
 
+    static const int MAX_RANK_CACHE_ENTRIES         = 32;
+
 
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -75,11 +93,39 @@ private:
 
     int64_t nLastWatchdogVoteTime;
 
+    /// Masternode ranking for one block hash and minimal protocol version
+    struct rank_cache_t {
+        // outpoints sorted by rank, best first
+        std::vector<COutPoint> vecOutpoints;
+        // outpoint -> rank, starting at 1
+        std::map<COutPoint, int> mapRanks;
+    };
+    typedef std::pair<uint256, int> rank_cache_key_t;
+
+    /// Rankings computed so far. A score depends on the block hash and on the masternode's
+    /// outpoint and nCollateralMinConfBlockHash, which both stay the same while the entry
+    /// is in the list, and entries are filtered by protocol version, so the rankings are
+    /// dropped whenever masternodes are added, removed or updated from a broadcast
+    std::map<rank_cache_key_t, rank_cache_t> mapRankCache;
+    /// Keys of mapRankCache in the order they were added, oldest first
+    std::list<rank_cache_key_t> listRankCacheKeys;
+
+    CMasternodePaidPayees paidPayees;
+    /// Last block scanned into paidPayees
+    const CBlockIndex* pindexLastPaidScan;
+    /// Lowest height of the window paidPayees was filled for
+    int nLastPaidScanFirstHeight;
+
     friend class CMasternodeSync;
     /// Find an entry
     CMasternode* Find(const COutPoint& outpoint);
 
     bool GetMasternodeScores(const uint256& nBlockHash, score_pair_vec_t& vecMasternodeScoresRet, int nMinProtocol = 0);
+    /// Get the (cached) ranking for a block, NULL if there is none
+    const rank_cache_t* GetRankCache(const uint256& nBlockHash, int nMinProtocol);
+    /// Forget all cached rankings, must be called whenever the set of masternodes
+    /// or their protocol versions change
+    void ClearRankCache();
 
 public:
     // Keep track of all broadcasts I've seen
@@ -117,6 +163,9 @@ public:
 
         READWRITE(mapSeenMasternodeBroadcast);
         READWRITE(mapSeenMasternodePing);
+        if(ser_action.ForRead()) {
+            ClearRankCache();
+        }
         if(ser_action.ForRead() && (strVersion != SERIALIZATION_VERSION_STRING)) {
             Clear();
         }
@@ -161,6 +210,8 @@ public:
     /// Versions of Find that are safe to use from outside the class
     bool Get(const COutPoint& outpoint, CMasternode& masternodeRet);
     bool Has(const COutPoint& outpoint);
+    /// Check whether an enabled masternode is listed at this address
+    bool Has(const CService& addr);
 
     bool GetMasternodeInfo(const COutPoint& outpoint, masternode_info_t& mnInfoRet);
     bool GetMasternodeInfo(const CPubKey& pubKeyMasternode, masternode_info_t& mnInfoRet);
@@ -185,6 +236,8 @@ public:
     std::pair<CService, std::set<uint256> > PopScheduledMnbRequestConnection();
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+    /** Route the message types handled by ProcessMessage here */
+    void RegisterMessageHandlers();
 
     void DoFullVerificationStep(CConnman& connman);
     void CheckSameAddr();
@@ -8,6 +8,9 @@
 
 #include "key.h"
 
+/** Default size limit of the cache of valid message signatures, in MiB */
+static const unsigned int DEFAULT_MAX_MSG_SIG_CACHE_SIZE = 8;
+
 /** Helper class for signing messages and checking their signatures
  */
 class CMessageSigner
@@ -28,7 +31,7 @@ class CHashSigner
 public:
     /// Sign the hash, returns true if successful
     static bool SignHash(const uint256& hash, const CKey key, std::vector<unsigned char>& vchSigRet);
-    /// Verify the hash signature, returns true if succcessful
+    /// Verify the hash signature, returns true if succcessful. Valid signatures are cached.
     static bool VerifyHash(const uint256& hash, const CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
 };
 
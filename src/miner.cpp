@@ -14,6 +14,7 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/neoscrypt.h"
 #include "hash.h"
 #include "validation.h"
 #include "net.h"
@@ -21,6 +22,7 @@
 #include "pow.h"
 #include "primitives/transaction.h"
 #include "script/standard.h"
+#include "streams.h"
 #include "timedata.h"
 #include "txmempool.h"
 #include "util.h"
@@ -407,6 +409,23 @@ static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainpar
     return true;
 }
 
+bool ScanBlockNonces(CBlockHeader* pblock, const arith_uint256& hashTarget, unsigned int nMaxTries)
+{
+    // Serialize the header once, neoscrypt_scan() only rewrites the nonce
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << *pblock;
+    assert(ss.size() == 80);
+
+    uint256 target = ArithToUint256(hashTarget);
+    uint256 hash;
+    unsigned int nNonce = pblock->nNonce;
+    bool fFound = neoscrypt_scan((const unsigned char*)&ss[0], &nNonce, nMaxTries, target.begin(), hash.begin());
+    pblock->nNonce = nNonce;
+    if (fFound)
+        pblock->SetCachedHash(hash);
+    return fFound;
+}
+
 // ***TODO*** that part changed in bitcoin, we are using a mix with old one here for now
 void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman)
 {
@@ -464,32 +483,20 @@ void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman)
             arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
             while (true)
             {
-                unsigned int nHashesDone = 0;
-
-                uint256 hash;
-                while (true)
+                // Hash up to the next multiple of 0x100 nonces at once
+                if (ScanBlockNonces(pblock, hashTarget, 0x100 - (pblock->nNonce & 0xFF)))
                 {
-                    hash = pblock->GetHash();
-                    if (UintToArith256(hash) <= hashTarget)
-                    {
-                        // Found a solution
-                        SetThreadPriority(THREAD_PRIORITY_NORMAL);
-                        LogPrintf("MogwaiMiner:\n  proof-of-work found\n  hash: %s\n  target: %s\n", hash.GetHex(), hashTarget.GetHex());
-                        ProcessBlockFound(pblock, chainparams);
-                        SetThreadPriority(THREAD_PRIORITY_LOWEST);
-                        coinbaseScript->KeepScript();
-
-                        // In regression test mode, stop mining after a block is found. This
-                        // allows developers to controllably generate a block on demand.
-                        if (chainparams.MineBlocksOnDemand())
-                            throw boost::thread_interrupted();
-
-                        break;
-                    }
-                    pblock->nNonce += 1;
-                    nHashesDone += 1;
-                    if ((pblock->nNonce & 0xFF) == 0)
-                        break;
+                    // Found a solution
+                    SetThreadPriority(THREAD_PRIORITY_NORMAL);
+                    LogPrintf("MogwaiMiner:\n  proof-of-work found\n  hash: %s\n  target: %s\n", pblock->GetHash().GetHex(), hashTarget.GetHex());
+                    ProcessBlockFound(pblock, chainparams);
+                    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+                    coinbaseScript->KeepScript();
+
+                    // In regression test mode, stop mining after a block is found. This
+                    // allows developers to controllably generate a block on demand.
+                    if (chainparams.MineBlocksOnDemand())
+                        throw boost::thread_interrupted();
                 }
 
                 // Check for stop or if block needs to be rebuilt
@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 
+class arith_uint256;
 class CBlockIndex;
 class CChainParams;
 class CConnman;
@@ -37,5 +38,9 @@ CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& s
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
+/** Search up to nMaxTries nonces of the block, starting with its current one, for a
+ *  hash not above hashTarget; on success the block holds the solving nonce, otherwise
+ *  its nonce is left just past the last one tried */
+bool ScanBlockNonces(CBlockHeader* pblock, const arith_uint256& hashTarget, unsigned int nMaxTries);
 
 #endif // BITCOIN_MINER_H
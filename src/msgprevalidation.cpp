@@ -0,0 +1,146 @@
+// Copyright (c) 2017-2018 The Mogwai Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "msgprevalidation.h"
+
+#include "governance-vote.h"
+#include "instantx.h"
+#include "masternode.h"
+#include "masternodeman.h"
+#include "protocol.h"
+#include "util.h"
+
+CMessagePrevalidation msgPrevalidation;
+
+void CMessagePrevalidation::Start(CConnman* connmanIn)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    connman = connmanIn;
+    fRunning = true;
+}
+
+bool CMessagePrevalidation::IsPrevalidated(const std::string& strCommand)
+{
+    return strCommand == NetMsgType::MNANNOUNCE ||
+           strCommand == NetMsgType::MNPING ||
+           strCommand == NetMsgType::MNGOVERNANCEOBJECTVOTE ||
+           strCommand == NetMsgType::TXLOCKVOTE;
+}
+
+bool CMessagePrevalidation::CanSubmit(NodeId nodeid, const std::string& strCommand)
+{
+    if (!IsPrevalidated(strCommand))
+        return false;
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!fRunning)
+        return false;
+    std::map<NodeId, std::deque<CJobRef> >::const_iterator it = mapNodeJobs.find(nodeid);
+    return it == mapNodeJobs.end() || it->second.size() < MAX_PREVALIDATION_PER_NODE;
+}
+
+bool CMessagePrevalidation::Submit(NodeId nodeid, const std::string& strCommand, std::list<CNetMessage>& msgs)
+{
+    if (!CanSubmit(nodeid, strCommand))
+        return false;
+
+    CJobRef job = std::make_shared<CJob>();
+    job->nodeId = nodeid;
+    job->strCommand = strCommand;
+    job->msgs.splice(job->msgs.begin(), msgs, msgs.begin());
+    job->fDone = false;
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        queueJobs.push_back(job);
+        mapNodeJobs[nodeid].push_back(job);
+    }
+    condWork.notify_one();
+    return true;
+}
+
+bool CMessagePrevalidation::HasPending(NodeId nodeid)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return mapNodeJobs.count(nodeid) > 0;
+}
+
+bool CMessagePrevalidation::PopReady(NodeId nodeid, std::list<CNetMessage>& msgs)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    std::map<NodeId, std::deque<CJobRef> >::iterator it = mapNodeJobs.find(nodeid);
+    if (it == mapNodeJobs.end() || !it->second.front()->fDone)
+        return false;
+
+    CJobRef job = it->second.front();
+    it->second.pop_front();
+    if (it->second.empty())
+        mapNodeJobs.erase(it);
+    msgs.splice(msgs.begin(), job->msgs);
+    return true;
+}
+
+void CMessagePrevalidation::RemoveNode(NodeId nodeid)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    // jobs already queued are still checked, nobody picks up the result
+    mapNodeJobs.erase(nodeid);
+}
+
+void CMessagePrevalidation::Prevalidate(const std::string& strCommand, CDataStream& vRecv)
+{
+    // Malformed messages and failed checks are left to the message handler,
+    // which repeats them anyway and knows what to do about the peer
+    int nDos = 0;
+    try {
+        if (strCommand == NetMsgType::MNANNOUNCE) {
+            CMasternodeBroadcast mnb;
+            vRecv >> mnb;
+            if (mnb.CheckSignature(nDos) && !mnb.lastPing.vchSig.empty())
+                mnb.lastPing.CheckSignature(mnb.pubKeyMasternode, nDos);
+        } else if (strCommand == NetMsgType::MNPING) {
+            CMasternodePing mnp;
+            vRecv >> mnp;
+            masternode_info_t infoMn;
+            if (mnodeman.GetMasternodeInfo(mnp.vin.prevout, infoMn))
+                mnp.CheckSignature(infoMn.pubKeyMasternode, nDos);
+        } else if (strCommand == NetMsgType::MNGOVERNANCEOBJECTVOTE) {
+            CGovernanceVote vote;
+            vRecv >> vote;
+            vote.IsValid(true);
+        } else if (strCommand == NetMsgType::TXLOCKVOTE) {
+            CTxLockVote vote;
+            vRecv >> vote;
+            vote.CheckSignature();
+        }
+    } catch (const std::exception& e) {
+        LogPrint("net", "CMessagePrevalidation::Prevalidate -- %s: %s\n", SanitizeString(strCommand), e.what());
+    }
+}
+
+void CMessagePrevalidation::ThreadPrevalidation()
+{
+    RenameThread("mogwai-msgcheck");
+
+    while (true) {
+        CJobRef job;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queueJobs.empty())
+                condWork.wait(lock);
+            job = queueJobs.front();
+            queueJobs.pop_front();
+        }
+
+        // work on a copy, the message handler reads the message from the start again
+        CDataStream vRecv(job->msgs.front().vRecv);
+        Prevalidate(job->strCommand, vRecv);
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            job->fDone = true;
+        }
+        connman->WakeMessageHandler();
+    }
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2017-2018 The Mogwai Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MSGPREVALIDATION_H
+#define MSGPREVALIDATION_H
+
+#include "net.h"
+
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CMessagePrevalidation;
+
+/** Default number of message pre-validation threads, 0 disables them */
+static const int DEFAULT_MSGPREVALIDATION_THREADS = 2;
+/** Maximum number of message pre-validation threads */
+static const int MAX_MSGPREVALIDATION_THREADS = 16;
+/** Messages of a single peer that may be waiting for the workers at once */
+static const size_t MAX_PREVALIDATION_PER_NODE = 1000;
+
+extern CMessagePrevalidation msgPrevalidation;
+
+/**
+ * Checks the signatures of masternode announcements and pings, governance
+ * votes and InstantSend lock votes on worker threads, before the message
+ * handler gets to them. Nothing is decided here: valid signatures end up in
+ * CHashSigner's signature cache, so the message handler runs the usual logic
+ * without repeating the expensive part. A peer's messages are still processed
+ * in the order they arrived.
+ */
+class CMessagePrevalidation
+{
+private:
+    struct CJob {
+        NodeId nodeId;
+        std::string strCommand;
+        std::list<CNetMessage> msgs;
+        bool fDone;
+    };
+    typedef std::shared_ptr<CJob> CJobRef;
+
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    // jobs waiting for a worker
+    std::deque<CJobRef> queueJobs;
+    // all unfinished jobs of every peer, in arrival order
+    std::map<NodeId, std::deque<CJobRef> > mapNodeJobs;
+
+    CConnman* connman;
+    bool fRunning;
+
+    static bool IsPrevalidated(const std::string& strCommand);
+    static void Prevalidate(const std::string& strCommand, CDataStream& vRecv);
+
+public:
+    CMessagePrevalidation() : connman(NULL), fRunning(false) {}
+
+    /** Enable submitting messages, call before starting the worker threads and the network */
+    void Start(CConnman* connmanIn);
+
+    /** Whether a message of this type from this peer would be taken by Submit */
+    bool CanSubmit(NodeId nodeid, const std::string& strCommand);
+    /**
+     * Hand the message over to the workers, it's moved out of msgs if this returns true.
+     * The caller keeps counting it toward the peer's receive buffer until PopReady hands it back.
+     */
+    bool Submit(NodeId nodeid, const std::string& strCommand, std::list<CNetMessage>& msgs);
+    /** Whether any message of this peer is still with the workers */
+    bool HasPending(NodeId nodeid);
+    /** Take back the peer's oldest message if its checks are done */
+    bool PopReady(NodeId nodeid, std::list<CNetMessage>& msgs);
+    /** Forget a disconnected peer's messages */
+    void RemoveNode(NodeId nodeid);
+
+    void ThreadPrevalidation();
+};
+
+#endif
@@ -44,6 +44,13 @@
 
 #include <math.h>
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+
+// Events handled per wakeup of the socket handler
+static const int MAX_SOCKET_EVENTS = 256;
+#endif
+
 // Dump addresses to peers.dat and banlist.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
 
@@ -426,6 +433,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
         }
 
         GetNodeSignals().InitializeNode(pnode, *this);
+        AddNodeSocket(pnode);
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
 
@@ -699,6 +707,11 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         if (handled < 0)
                 return false;
 
+        if (msg.in_data && msg.nDataPos == 0 && memcmp(msg.hdr.pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0) {
+            LogPrintf("PROCESSMESSAGE: INVALID MESSAGESTART %s peer=%d\n", SanitizeString(msg.hdr.GetCommand()), GetId());
+            return false;
+        }
+
         if (msg.in_data && msg.hdr.nMessageSize > MAX_PROTOCOL_MESSAGE_LENGTH) {
             LogPrint("net", "Oversized message from peer=%i, disconnecting\n", GetId());
             return false;
@@ -717,6 +730,18 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
             assert(i != mapRecvBytesPerMsgCmd.end());
             i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
 
+            // The data was hashed as it arrived, drop a corrupted message
+            // here instead of queueing it for the message handler
+            const uint256& hash = msg.GetMessageHash();
+            if (memcmp(hash.begin(), msg.hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) != 0) {
+                LogPrintf("%s(%s, %u bytes): CHECKSUM ERROR expected %s was %s peer=%d\n", __func__,
+                   SanitizeString(msg.hdr.GetCommand()), msg.hdr.nMessageSize,
+                   HexStr(hash.begin(), hash.begin()+CMessageHeader::CHECKSUM_SIZE),
+                   HexStr(msg.hdr.pchChecksum, msg.hdr.pchChecksum+CMessageHeader::CHECKSUM_SIZE), GetId());
+                vRecvMsg.pop_back();
+                continue;
+            }
+
             msg.nTime = nTimeMicros;
             complete = true;
         }
@@ -793,12 +818,21 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
         vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
     }
 
+    hasher.Write((const unsigned char*)pch, nCopy);
     memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+const uint256& CNetMessage::GetMessageHash() const
+{
+    assert(complete());
+    if (data_hash.IsNull())
+        hasher.Finalize(data_hash.begin());
+    return data_hash;
+}
+
 
 
 
@@ -826,6 +860,11 @@ size_t CConnman::SocketSendData(CNode *pnode)
                 pnode->nSendOffset = 0;
                 pnode->nSendSize -= data.size();
                 pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                if (pnode->vSendBufferPool.size() < SEND_BUFFER_POOL_SIZE && it->capacity() <= MAX_POOLED_SEND_BUFFER) {
+                    it->clear();
+                    pnode->vSendBufferPool.emplace_back();
+                    pnode->vSendBufferPool.back().swap(*it);
+                }
                 it++;
             } else {
                 // could not send full message; stop sending more
@@ -1100,15 +1139,43 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint("net", "connection from %s accepted\n", addr.ToString());
 
+    AddNodeSocket(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
 }
 
+void CConnman::AddNodeSocket(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    // Edge-triggered: the handler keeps the readiness in fSocketReadable and
+    // fSocketWritable until a recv or send would block
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &event) == -1) {
+        LogPrintf("%s -- epoll_ctl failed for peer=%d: %s\n", __func__, pnode->id, NetworkErrorString(errno));
+        pnode->fDisconnect = true;
+    }
+#endif
+}
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+#ifdef USE_EPOLL
+    // Listening sockets are level-triggered, one connection is accepted per wakeup
+    BOOST_FOREACH(ListenSocket& hListenSocket, vhListenSocket) {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = &hListenSocket;
+        if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hListenSocket.socket, &event) == -1)
+            LogPrintf("ThreadSocketHandler -- epoll_ctl failed for listening socket: %s\n", NetworkErrorString(errno));
+    }
+    // Set when a socket may still hold unread data, the next wait must not block
+    bool fMoreWork = false;
+#endif
     while (!interruptNet)
     {
         //
@@ -1181,6 +1248,51 @@ void CConnman::ThreadSocketHandler()
                 clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
         }
 
+#ifdef USE_EPOLL
+        //
+        // Wait for socket events. Registration is persistent, so unlike
+        // select() nothing has to be rebuilt for every node here.
+        //
+        struct epoll_event events[MAX_SOCKET_EVENTS];
+        int nEvents = epoll_wait(hEpoll, events, MAX_SOCKET_EVENTS, fMoreWork ? 0 : 50);
+        if (interruptNet)
+            return;
+        fMoreWork = false;
+
+        if (nEvents == -1)
+        {
+            int nErr = errno;
+            nEvents = 0;
+            if (nErr != EINTR) {
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+                if (!interruptNet.sleep_for(std::chrono::milliseconds(50)))
+                    return;
+            }
+        }
+
+        for (int i = 0; i < nEvents; i++)
+        {
+            //
+            // Accept new connections
+            //
+            const ListenSocket* pListenSocket = NULL;
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+                if (events[i].data.ptr == &hListenSocket)
+                    pListenSocket = &hListenSocket;
+            if (pListenSocket) {
+                AcceptConnection(*pListenSocket);
+                continue;
+            }
+
+            // Nodes are only deleted by this thread, after their socket was
+            // closed and so removed from the epoll set
+            CNode* pnode = static_cast<CNode*>(events[i].data.ptr);
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                pnode->fSocketReadable = true;
+            if (events[i].events & EPOLLOUT)
+                pnode->fSocketWritable = true;
+        }
+#else
         //
         // Find which sockets have data to receive
         //
@@ -1269,6 +1381,7 @@ void CConnman::ThreadSocketHandler()
                 AcceptConnection(hListenSocket);
             }
         }
+#endif
 
         //
         // Service each socket
@@ -1284,7 +1397,22 @@ void CConnman::ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+#ifdef USE_EPOLL
+            // The same policy the select() setup applies: drain queued sends
+            // before reading more, and leave data of paused peers in the kernel
+            bool fSendQueued = false;
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend)
+                    fSendQueued = !pnode->vSendMsg.empty();
+            }
+            bool fRecv = pnode->fSocketReadable && !fSendQueued && !pnode->fPauseRecv;
+            bool fSend = pnode->fSocketWritable && fSendQueued;
+#else
+            bool fRecv = FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError);
+            bool fSend = FD_ISSET(pnode->hSocket, &fdsetSend);
+#endif
+            if (fRecv)
             {
                 {
                     {
@@ -1293,6 +1421,11 @@ void CConnman::ThreadSocketHandler()
                         int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
                         if (nBytes > 0)
                         {
+#ifdef USE_EPOLL
+                            // a full buffer may have left more behind, come back without waiting
+                            if (nBytes == (int)sizeof(pchBuf))
+                                fMoreWork = true;
+#endif
                             bool notify = false;
                             if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
                                 pnode->CloseSocketDisconnect();
@@ -1325,6 +1458,8 @@ void CConnman::ThreadSocketHandler()
                         {
                             // error
                             int nErr = WSAGetLastError();
+                            if (nErr == WSAEWOULDBLOCK)
+                                pnode->fSocketReadable = false;
                             if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                             {
                                 if (!pnode->fDisconnect)
@@ -1341,7 +1476,7 @@ void CConnman::ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (fSend)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend) {
@@ -1349,6 +1484,9 @@ void CConnman::ThreadSocketHandler()
                     if (nBytes) {
                         RecordBytesSent(nBytes);
                     }
+                    // whatever is left did not fit, wait until the socket drains
+                    if (!pnode->vSendMsg.empty())
+                        pnode->fSocketWritable = false;
                 }
             }
 
@@ -1923,6 +2061,8 @@ void CConnman::ThreadMessageHandler()
     {
         std::vector<CNode*> vNodesCopy = CopyNodeVector();
 
+        FlushRelayQueue(vNodesCopy);
+
         bool fMoreWork = false;
 
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
@@ -2146,6 +2286,9 @@ CConnman::CConnman()
     nBestHeight = 0;
     clientInterface = NULL;
     flagInterruptMsgProc = false;
+#ifdef USE_EPOLL
+    hEpoll = -1;
+#endif
 }
 
 NodeId CConnman::GetNewNodeId()
@@ -2226,6 +2369,14 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         GetNodeSignals().InitializeNode(pnodeLocalHost, *this);
     }
 
+#ifdef USE_EPOLL
+    hEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (hEpoll == -1) {
+        strNodeError = strprintf("Failed to create epoll instance: %s", NetworkErrorString(errno));
+        return false;
+    }
+#endif
+
     //
     // Start threads
     //
@@ -2347,6 +2498,11 @@ void CConnman::Stop()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+#ifdef USE_EPOLL
+    if (hEpoll != -1)
+        close(hEpoll);
+    hEpoll = -1;
+#endif
     delete semOutbound;
     semOutbound = NULL;
     delete semMasternodeOutbound;
@@ -2510,26 +2666,67 @@ void CConnman::RelayTransaction(const CTransaction& tx, const CDataStream& ss)
         mapRelay.insert(std::make_pair(inv, ss));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
-    LOCK(cs_vNodes);
-    BOOST_FOREACH(CNode* pnode, vNodes)
+    QueueRelayInv({inv, 0, std::make_shared<const CTransaction>(tx)});
+}
+
+void CConnman::RelayInv(CInv &inv, const int minProtoVersion) {
+    QueueRelayInv({inv, minProtoVersion, nullptr});
+}
+
+void CConnman::QueueRelayInv(const CQueuedRelayInv& queued)
+{
+    bool fWake, fFull;
     {
-        if(!pnode->fRelayTxes)
-            continue;
-        LOCK(pnode->cs_filter);
-        if (pnode->pfilter)
-        {
-            if (pnode->pfilter->IsRelevantAndUpdate(tx))
-                pnode->PushInventory(inv);
-        } else
-            pnode->PushInventory(inv);
+        LOCK(cs_vRelayQueue);
+        fWake = vRelayQueue.empty();
+        vRelayQueue.push_back(queued);
+        fFull = vRelayQueue.size() >= MAX_RELAY_QUEUE_SZ;
+    }
+    if (fFull) {
+        // The message handler isn't keeping up, hand the queue to the peers from here
+        std::vector<CNode*> vNodesCopy = CopyNodeVector();
+        FlushRelayQueue(vNodesCopy);
+        ReleaseNodeVector(vNodesCopy);
+    } else if (fWake) {
+        WakeMessageHandler();
     }
 }
 
-void CConnman::RelayInv(CInv &inv, const int minProtoVersion) {
-    LOCK(cs_vNodes);
-    BOOST_FOREACH(CNode* pnode, vNodes)
-        if(pnode->nVersion >= minProtoVersion)
-            pnode->PushInventory(inv);
+void CConnman::FlushRelayQueue(const std::vector<CNode*>& vNodesCopy)
+{
+    std::vector<CQueuedRelayInv> vQueue;
+    {
+        LOCK(cs_vRelayQueue);
+        vQueue.swap(vRelayQueue);
+    }
+    if (vQueue.empty())
+        return;
+
+    std::vector<CInv> vInv;
+    vInv.reserve(vQueue.size());
+    BOOST_FOREACH(CNode* pnode, vNodesCopy)
+    {
+        if (pnode->fDisconnect)
+            continue;
+        vInv.clear();
+        {
+            LOCK(pnode->cs_filter);
+            BOOST_FOREACH(const CQueuedRelayInv& queued, vQueue)
+            {
+                if (queued.tx) {
+                    if (!pnode->fRelayTxes)
+                        continue;
+                    if (pnode->pfilter && !pnode->pfilter->IsRelevantAndUpdate(*queued.tx))
+                        continue;
+                } else if (pnode->nVersion < queued.nMinProtoVersion) {
+                    continue;
+                }
+                vInv.push_back(queued.inv);
+            }
+        }
+        if (!vInv.empty())
+            pnode->PushInventory(vInv);
+    }
 }
 
 void CConnman::RecordBytesRecv(uint64_t bytes)
@@ -2716,6 +2913,8 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nLocalServices = nLocalServicesIn;
     fPauseRecv = false;
     fPauseSend = false;
+    fSocketReadable = false;
+    fSocketWritable = false;
     nProcessQueueSize = 0;
 
     GetRandBytes((unsigned char*)&nLocalHostNonce, sizeof(nLocalHostNonce));
@@ -2816,7 +3015,19 @@ std::vector<unsigned char> CNode::CalculateKeyedNetGroup(CAddress& address)
 
 CDataStream CConnman::BeginMessage(CNode* pnode, int nVersion, int flags, const std::string& sCommand)
 {
-    return {SER_NETWORK, (nVersion ? nVersion : pnode->GetSendVersion()) | flags, CMessageHeader(Params().MessageStart(), sCommand.c_str(), 0) };
+    // Serialize into a buffer of a message sent earlier if there is one. Network
+    // messages are public, they don't need to be cleared when freed.
+    CSerializeData data(CSerializeData::allocator_type(false));
+    {
+        LOCK(pnode->cs_vSend);
+        if (!pnode->vSendBufferPool.empty()) {
+            data.swap(pnode->vSendBufferPool.back());
+            pnode->vSendBufferPool.pop_back();
+        }
+    }
+    CDataStream strm(std::move(data), SER_NETWORK, (nVersion ? nVersion : pnode->GetSendVersion()) | flags);
+    strm << CMessageHeader(Params().MessageStart(), sCommand.c_str(), 0);
+    return strm;
 }
 
 void CConnman::EndMessage(CDataStream& strm)
@@ -2846,12 +3057,15 @@ void CConnman::PushMessage(CNode* pnode, CDataStream& strm, const std::string& s
             return;
         }
         bool optimisticSend(pnode->vSendMsg.empty());
-        pnode->vSendMsg.emplace_back(strm.begin(), strm.end());
 
         //log total amount of bytes per command
         pnode->mapSendBytesPerMsgCmd[sCommand] += strm.size();
         pnode->nSendSize += strm.size();
 
+        // the message is queued without copying it, strm is left empty
+        pnode->vSendMsg.emplace_back();
+        strm.GetAndClear(pnode->vSendMsg.back());
+
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
 
@@ -10,6 +10,7 @@
 #include "addrman.h"
 #include "bloom.h"
 #include "compat.h"
+#include "hash.h"
 #include "limitedmap.h"
 #include "netaddress.h"
 #include "protocol.h"
@@ -71,6 +72,8 @@ static const bool DEFAULT_UPNP = USE_UPNP;
 #else
 static const bool DEFAULT_UPNP = false;
 #endif
+/** The maximum number of relayed entries waiting for the message handler to hand them to the peers */
+static const size_t MAX_RELAY_QUEUE_SZ = MAX_INV_SZ;
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 /** The maximum number of entries in setAskFor (larger due to getdata latency)*/
@@ -85,6 +88,10 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Number of sent message buffers a peer keeps for its next messages */
+static const size_t SEND_BUFFER_POOL_SIZE = 4;
+/** Larger send buffers are freed rather than kept for reuse */
+static const size_t MAX_POOLED_SEND_BUFFER = 64 * 1024;
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
@@ -387,6 +394,9 @@ public:
 
 
     unsigned int GetReceiveFloodSize() const;
+
+    /** Let the message handler know there may be work, e.g. from other threads handing messages back */
+    void WakeMessageHandler();
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -400,12 +410,12 @@ private:
     void ThreadOpenConnections();
     void ThreadMessageHandler();
     void AcceptConnection(const ListenSocket& hListenSocket);
+    /** Start watching a new node's socket in the socket handler */
+    void AddNodeSocket(CNode* pnode);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
     void ThreadMnbRequestConnections();
 
-    void WakeMessageHandler();
-
     CNode* FindNode(const CNetAddr& ip);
     CNode* FindNode(const CSubNet& subNet);
     CNode* FindNode(const std::string& addrName);
@@ -437,9 +447,24 @@ private:
     void RecordBytesRecv(uint64_t bytes);
     void RecordBytesSent(uint64_t bytes);
 
+    //! Hand the inventory queued by RelayTransaction and RelayInv to the peers
+    void FlushRelayQueue(const std::vector<CNode*>& vNodesCopy);
+
     // Whether the node should be passed out in ForEach* callbacks
     static bool NodeFullyConnected(const CNode* pnode);
 
+    // Inventory to relay, handed to the peers in one go by the message handler
+    struct CQueuedRelayInv {
+        CInv inv;
+        int nMinProtoVersion;
+        //! Set for transactions, checked against the peers' bloom filters
+        std::shared_ptr<const CTransaction> tx;
+    };
+    CCriticalSection cs_vRelayQueue;
+    std::vector<CQueuedRelayInv> vRelayQueue;
+
+    void QueueRelayInv(const CQueuedRelayInv& queued);
+
     // Network usage totals
     CCriticalSection cs_totalBytesRecv;
     CCriticalSection cs_totalBytesSent;
@@ -461,6 +486,10 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+#ifdef USE_EPOLL
+    // Sockets are registered once and stay in the set until they are closed
+    int hEpoll;
+#endif
     bool fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
@@ -619,6 +648,9 @@ public:
 
 
 class CNetMessage {
+private:
+    mutable CHash256 hasher;        // running hash of the data received so far
+    mutable uint256 data_hash;
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
@@ -631,7 +663,10 @@ public:
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
+    // Nothing secret is received from the network, the buffers aren't cleared when freed
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) :
+        hdrbuf(CSerializeData(CSerializeData::allocator_type(false)), nTypeIn, nVersionIn), hdr(pchMessageStartIn),
+        vRecv(CSerializeData(CSerializeData::allocator_type(false)), nTypeIn, nVersionIn) {
         hdrbuf.resize(24);
         in_data = false;
         nHdrPos = 0;
@@ -652,6 +687,9 @@ public:
         vRecv.SetVersion(nVersionIn);
     }
 
+    /** Double SHA256 of the message data, the message must be complete */
+    const uint256& GetMessageHash() const;
+
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
 };
@@ -670,6 +708,7 @@ public:
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
     std::deque<CSerializeData> vSendMsg;
+    std::vector<CSerializeData> vSendBufferPool; // emptied buffers of sent messages, to serialize the next ones into
     CCriticalSection cs_vSend;
 
     CCriticalSection cs_vProcessMsg;
@@ -719,6 +758,10 @@ public:
 
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Socket readiness as last seen by the socket handler thread. epoll
+    // reports edges, so these stay set until a read or write would block.
+    bool fSocketReadable;
+    bool fSocketWritable;
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -876,6 +919,19 @@ public:
         }
     }
 
+    void PushInventory(const std::vector<CInv>& vInv)
+    {
+        LOCK(cs_inventory);
+        BOOST_FOREACH(const CInv& inv, vInv) {
+            if (inv.type == MSG_TX && filterInventoryKnown.contains(inv.hash)) {
+                LogPrint("net", "PushInventory --  filtered inv: %s peer=%d\n", inv.ToString(), id);
+                continue;
+            }
+            LogPrint("net", "PushInventory --  inv: %s peer=%d\n", inv.ToString(), id);
+            vInventoryToSend.push_back(inv);
+        }
+    }
+
     void PushBlockHash(const uint256 &hash)
     {
         LOCK(cs_inventory);
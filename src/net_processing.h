@@ -14,6 +14,25 @@
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_BASE = 15 * 60 * 1000000; // 15 minutes
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_PER_HEADER = 1000; // 1ms/header
 
+/**
+ * Handler for a message type owned by one of the Mogwai subsystems
+ * (masternodes, PrivateSend, InstantSend, sporks, governance).
+ */
+typedef std::function<void(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman)> NetMsgHandler;
+
+/** Route a message type to a subsystem handler, must be called before the network threads start */
+void RegisterNetMsgHandler(const std::string& strCommand, const NetMsgHandler& handler);
+/** Remove all subsystem message handlers */
+void UnregisterNetMsgHandlers();
+
+struct CNetMsgStats {
+    uint64_t nCount;
+    int64_t nTimeMicros;
+};
+
+/** Number of messages processed and time spent handling them, by message type */
+std::map<std::string, CNetMsgStats> GetNetMsgStats();
+
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
 /** Unregister a network node */
@@ -35,6 +54,11 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nBlocksInFlightMax;
+    int64_t nAvgBlockTime;
+    uint64_t nBlocksDownloaded;
+    uint64_t nBlockBytesDownloaded;
+    uint64_t nBlocksReassigned;
 };
 
 /** Get statistics from node state */
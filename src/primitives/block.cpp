@@ -13,13 +13,49 @@
 
 uint256 CBlockHeader::GetHash() const
 {
+        if (fHashCached && memcmp(vchHashedHeader, &nVersion, sizeof(vchHashedHeader)) == 0)
+            return hashCached;
+
         uint256 thash;
         unsigned int profile = 0x0;
         neoscrypt((unsigned char *) &nVersion, (unsigned char *) &thash, profile);
+
+        SetCachedHash(thash);
         return thash;
 
 }
 
+void CBlockHeader::SetCachedHash(const uint256& hash) const
+{
+    memcpy(vchHashedHeader, &nVersion, sizeof(vchHashedHeader));
+    hashCached = hash;
+    fHashCached = true;
+}
+
+void GetBlockHeaderHashes(const CBlockHeader* pheaders, size_t nCount, uint256* phashes)
+{
+    if (nCount == 0)
+        return;
+
+    std::vector<unsigned char> input(nCount * 80);
+    std::vector<unsigned char> output(nCount * 32);
+    for (size_t i = 0; i < nCount; i++)
+        memcpy(&input[i * 80], &pheaders[i].nVersion, 80);
+    neoscrypt_batch(&input[0], &output[0], nCount);
+    for (size_t i = 0; i < nCount; i++) {
+        memcpy(phashes[i].begin(), &output[i * 32], 32);
+        // Later GetHash() calls on these headers are free
+        pheaders[i].SetCachedHash(phashes[i]);
+    }
+}
+
+void GetBlockHeaderHashes(const std::vector<CBlockHeader>& headers, std::vector<uint256>& hashes)
+{
+    hashes.resize(headers.size());
+    if (!headers.empty())
+        GetBlockHeaderHashes(&headers[0], headers.size(), &hashes[0]);
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
@@ -28,6 +28,14 @@ public:
     uint32_t nBits;
     uint32_t nNonce;
 
+private:
+    // memory only: the last hash computed and the header bytes it was
+    // computed from, so that any change to the fields above invalidates it
+    mutable uint256 hashCached;
+    mutable unsigned char vchHashedHeader[80];
+    mutable bool fHashCached;
+
+public:
     CBlockHeader()
     {
         SetNull();
@@ -54,6 +62,7 @@ public:
         nTime = 0;
         nBits = 0;
         nNonce = 0;
+        fHashCached = false;
     }
 
     bool IsNull() const
@@ -61,8 +70,14 @@ public:
         return (nBits == 0);
     }
 
+    /** NeoScrypt hash of the header, computed at most once per header state */
     uint256 GetHash() const;
 
+    /** Seed the hash cache for the current header state. Only for hashes
+     *  already known to belong to this header, e.g. from a batch or the
+     *  block index. */
+    void SetCachedHash(const uint256& hash) const;
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -125,6 +140,12 @@ public:
 };
 
 
+/** Compute the hashes of many headers at once, several of them in parallel
+ * where the NeoScrypt engine supports it */
+void GetBlockHeaderHashes(const std::vector<CBlockHeader>& headers, std::vector<uint256>& hashes);
+void GetBlockHeaderHashes(const CBlockHeader* pheaders, size_t nCount, uint256* phashes);
+
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
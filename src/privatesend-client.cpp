@@ -10,6 +10,7 @@
 #include "init.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
+#include "net_processing.h"
 #include "script/sign.h"
 #include "txmempool.h"
 #include "util.h"
@@ -201,6 +202,17 @@ void CPrivateSendClient::ProcessMessage(CNode* pfrom, std::string& strCommand, C
     }
 }
 
+void CPrivateSendClient::RegisterMessageHandlers()
+{
+    NetMsgHandler handler = [this](CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman) {
+        ProcessMessage(pfrom, strCommand, vRecv, connman);
+    };
+    RegisterNetMsgHandler(NetMsgType::DSQUEUE, handler);
+    RegisterNetMsgHandler(NetMsgType::DSSTATUSUPDATE, handler);
+    RegisterNetMsgHandler(NetMsgType::DSFINALTX, handler);
+    RegisterNetMsgHandler(NetMsgType::DSCOMPLETE, handler);
+}
+
 void CPrivateSendClient::ResetPool()
 {
     nCachedLastSuccessBlock = 0;
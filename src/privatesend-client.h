@@ -123,6 +123,8 @@ public:
         fCreateAutoBackups(true) { SetNull(); }
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+    /** Route the message types handled by ProcessMessage here */
+    void RegisterMessageHandlers();
 
     void ClearSkippedDenominations() { vecDenominationsSkipped.clear(); }
 
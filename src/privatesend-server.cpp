@@ -10,6 +10,7 @@
 #include "init.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
+#include "net_processing.h"
 #include "script/interpreter.h"
 #include "txmempool.h"
 #include "util.h"
@@ -266,6 +267,17 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, std::string& strCommand, C
     }
 }
 
+void CPrivateSendServer::RegisterMessageHandlers()
+{
+    NetMsgHandler handler = [this](CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman) {
+        ProcessMessage(pfrom, strCommand, vRecv, connman);
+    };
+    RegisterNetMsgHandler(NetMsgType::DSACCEPT, handler);
+    RegisterNetMsgHandler(NetMsgType::DSQUEUE, handler);
+    RegisterNetMsgHandler(NetMsgType::DSVIN, handler);
+    RegisterNetMsgHandler(NetMsgType::DSSIGNFINALTX, handler);
+}
+
 void CPrivateSendServer::SetNull()
 {
     // MN side
@@ -71,6 +71,8 @@ public:
         fUnitTest(false) { SetNull(); }
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+    /** Route the message types handled by ProcessMessage here */
+    void RegisterMessageHandlers();
 
     void CheckTimeout(CConnman& connman);
     void CheckForCompleteQueue(CConnman& connman);
@@ -27,6 +27,7 @@
 
 #include <univalue.h>
 
+#include <boost/filesystem/operations.hpp>
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
 using namespace std;
@@ -660,6 +661,70 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+static UniValue DBInfo(const std::string& strName, const CDBWrapper& db)
+{
+    const CDBProfile& profile = db.GetProfile();
+
+    uint64_t nSize = 0;
+    boost::system::error_code ec;
+    for (boost::filesystem::directory_iterator it(db.GetPath(), ec), end; !ec && it != end; it.increment(ec)) {
+        if (boost::filesystem::is_regular_file(it->status()))
+            nSize += boost::filesystem::file_size(it->path(), ec);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("name", strName));
+    ret.push_back(Pair("path", db.GetPath().string()));
+    ret.push_back(Pair("profile", profile.strName));
+    ret.push_back(Pair("compression", profile.fCompression));
+    ret.push_back(Pair("block_size", (uint64_t)profile.nBlockSize));
+    ret.push_back(Pair("block_restart_interval", profile.nBlockRestartInterval));
+    ret.push_back(Pair("max_open_files", profile.nMaxOpenFiles));
+    ret.push_back(Pair("block_cache", (uint64_t)(db.GetCacheSize() * profile.nBlockCachePercent / 100)));
+    ret.push_back(Pair("write_buffer", (uint64_t)(db.GetCacheSize() * profile.nWriteBufferPercent / 100)));
+    ret.push_back(Pair("disk_size", nSize));
+    return ret;
+}
+
+UniValue getdbinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbinfo\n"
+            "\nReturns the LevelDB tuning profile and size of each database.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"name\",              (string) The database, as used with -dbprofile\n"
+            "    \"path\": \"path\",              (string) The database directory\n"
+            "    \"profile\": \"profile\",        (string) The tuning profile selected with -dbprofile\n"
+            "    \"compression\": true|false,   (boolean) Whether table blocks are Snappy compressed, if LevelDB was built with Snappy\n"
+            "    \"block_size\": n,             (numeric) The approximate size of a table block in bytes\n"
+            "    \"block_restart_interval\": n, (numeric) The number of keys between prefix compression restart points\n"
+            "    \"max_open_files\": n,         (numeric) The number of table files kept open\n"
+            "    \"block_cache\": n,            (numeric) The size of the block cache in bytes\n"
+            "    \"write_buffer\": n,           (numeric) The size of a write buffer in bytes\n"
+            "    \"disk_size\": n               (numeric) The size of the database files in bytes\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbinfo", "")
+            + HelpExampleRpc("getdbinfo", "")
+        );
+
+    LOCK(cs_main);
+
+    UniValue ret(UniValue::VARR);
+    ret.push_back(DBInfo("chainstate", pcoinsdbview->GetDB()));
+    ret.push_back(DBInfo("blockindex", *pblocktree));
+    for (const std::string& strName : GetIndexNames()) {
+        if (CIndexDB* pdb = GetIndexDB(strName))
+            ret.push_back(DBInfo(strName, *pdb));
+    }
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -7,6 +7,7 @@
 
 #include "base58.h"
 #include "clientversion.h"
+#include "indexer.h"
 #include "init.h"
 #include "net.h"
 #include "netbase.h"
@@ -731,6 +732,108 @@ bool timestampSort(std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> a,
     return a.second.time < b.second.time;
 }
 
+/** The "limit" option of the address history calls, 0 without it */
+size_t getAddressPageLimit(const UniValue& params)
+{
+    if (!params[0].isObject())
+        return 0;
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    if (limitValue.isNull()) {
+        if (!find_value(params[0].get_obj(), "cursor").isNull())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "A cursor needs a limit");
+        return 0;
+    }
+    if (!limitValue.isNum() || limitValue.get_int() <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be a positive number");
+
+    return limitValue.get_int();
+}
+
+/** Read the "cursor" option, the index key a page ended at, and find the address it belongs to */
+template<typename Key>
+bool getAddressPageCursor(const UniValue& params, const std::vector<std::pair<uint160, int> > &addresses,
+                          Key& key, size_t& nAddress)
+{
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (cursorValue.isNull())
+        return false;
+    if (!cursorValue.isStr() || !IsHex(cursorValue.get_str()))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+
+    CDataStream ss(ParseHex(cursorValue.get_str()), SER_DISK, CLIENT_VERSION);
+    try {
+        ss >> key;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+
+    for (nAddress = 0; nAddress < addresses.size(); nAddress++) {
+        if (addresses[nAddress].first == key.hashBytes && addresses[nAddress].second == (int)key.type)
+            return true;
+    }
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor doesn't belong to these addresses");
+}
+
+template<typename Key>
+std::string getAddressPageCursorString(const Key& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return HexStr(ss.begin(), ss.end());
+}
+
+/**
+ * Read up to nLimit address index entries of the addresses, one address after the other,
+ * continuing after the "cursor" option. Returns the cursor of the next page, or an empty
+ * string on the last page.
+ */
+std::string getAddressIndexPage(const UniValue& params, const std::vector<std::pair<uint160, int> > &addresses,
+                                int start, int end, size_t nLimit,
+                                std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex)
+{
+    CAddressIndexKey keyAfter;
+    size_t nAddress = 0;
+    bool fCursor = getAddressPageCursor(params, addresses, keyAfter, nAddress);
+    bool fMore = false;
+
+    for (; nAddress < addresses.size(); nAddress++, fCursor = false) {
+        if (!GetAddressIndexPage(addresses[nAddress].first, addresses[nAddress].second, start, end,
+                                 fCursor ? &keyAfter : NULL, nLimit - addressIndex.size(), addressIndex, fMore)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+        if (addressIndex.size() == nLimit)
+            break;
+    }
+
+    if (addressIndex.size() == nLimit && (fMore || nAddress + 1 < addresses.size()))
+        return getAddressPageCursorString(addressIndex.back().first);
+    return "";
+}
+
+/** Like getAddressIndexPage, for unspent outputs */
+std::string getAddressUnspentPage(const UniValue& params, const std::vector<std::pair<uint160, int> > &addresses,
+                                  size_t nLimit, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+{
+    CAddressUnspentKey keyAfter;
+    size_t nAddress = 0;
+    bool fCursor = getAddressPageCursor(params, addresses, keyAfter, nAddress);
+    bool fMore = false;
+
+    for (; nAddress < addresses.size(); nAddress++, fCursor = false) {
+        if (!GetAddressUnspentPage(addresses[nAddress].first, addresses[nAddress].second,
+                                   fCursor ? &keyAfter : NULL, nLimit - unspentOutputs.size(), unspentOutputs, fMore)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+        if (unspentOutputs.size() == nLimit)
+            break;
+    }
+
+    if (unspentOutputs.size() == nLimit && (fMore || nAddress + 1 < addresses.size()))
+        return getAddressPageCursorString(unspentOutputs.back().first);
+    return "";
+}
+
 UniValue getaddressmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -815,6 +918,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "      \"address\"  (string) The base58check encoded address\n"
             "      ,...\n"
             "    ]\n"
+            "  \"limit\" (number, optional) Return at most this many outputs, in index order\n"
+            "  \"cursor\" (string, optional) Continue after the page that returned this cursor\n"
             "}\n"
             "\nResult\n"
             "[\n"
@@ -827,8 +932,14 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "    \"height\"  (number) The block height\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit):\n"
+            "{\n"
+            "  \"utxos\"  (array) The outputs as above\n"
+            "  \"cursor\"  (string) Pass this to get the next page, missing on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'")
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}")
         );
 
@@ -839,14 +950,20 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
     }
 
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    size_t nLimit = getAddressPageLimit(params);
+    std::string strCursor;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    if (nLimit > 0) {
+        strCursor = getAddressUnspentPage(params, addresses, nLimit, unspentOutputs);
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
         }
-    }
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+    }
 
     UniValue result(UniValue::VARR);
 
@@ -866,6 +983,14 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
         result.push_back(output);
     }
 
+    if (nLimit > 0) {
+        UniValue page(UniValue::VOBJ);
+        page.push_back(Pair("utxos", result));
+        if (!strCursor.empty())
+            page.push_back(Pair("cursor", strCursor));
+        return page;
+    }
+
     return result;
 }
 
@@ -884,6 +1009,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many changes\n"
+            "  \"cursor\" (string, optional) Continue after the page that returned this cursor\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -896,8 +1023,14 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit):\n"
+            "{\n"
+            "  \"deltas\"  (array) The changes as above\n"
+            "  \"cursor\"  (string) Pass this to get the next page, missing on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'")
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}")
         );
 
@@ -923,15 +1056,22 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     }
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    size_t nLimit = getAddressPageLimit(params);
+    std::string strCursor;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    if (nLimit > 0) {
+        bool fRange = start > 0 && end > 0;
+        strCursor = getAddressIndexPage(params, addresses, fRange ? start : 0, fRange ? end : 0, nLimit, addressIndex);
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (start > 0 && end > 0) {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            } else {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
             }
         }
     }
@@ -954,6 +1094,14 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         result.push_back(delta);
     }
 
+    if (nLimit > 0) {
+        UniValue page(UniValue::VOBJ);
+        page.push_back(Pair("deltas", result));
+        if (!strCursor.empty())
+            page.push_back(Pair("cursor", strCursor));
+        return page;
+    }
+
     return result;
 }
 
@@ -987,22 +1135,34 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    CAmount balance = 0;
+    CAmount received = 0;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    // the totals are a single read each, unless they're still being built
+    if (chainIndexer.GetBestBlock("addressbalance") == chainIndexer.GetBestBlock("addressindex")) {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            CAddressBalanceValue value;
+            if (!GetAddressBalance((*it).first, (*it).second, value)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+            balance += value.balance;
+            received += value.received;
         }
-    }
+    } else {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
-    CAmount balance = 0;
-    CAmount received = 0;
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        }
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+            if (it->second > 0) {
+                received += it->second;
+            }
+            balance += it->second;
         }
-        balance += it->second;
     }
 
     UniValue result(UniValue::VOBJ);
@@ -1028,14 +1188,23 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Read at most this many address changes, a page has at most\n"
+            "                    as many txids. A txid may show up again on a later page.\n"
+            "  \"cursor\" (string, optional) Continue after the page that returned this cursor\n"
             "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with limit):\n"
+            "{\n"
+            "  \"txids\"  (array) The transaction ids as above\n"
+            "  \"cursor\"  (string) Pass this to get the next page, missing on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}'")
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\"]}")
         );
 
@@ -1057,15 +1226,22 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
     }
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    size_t nLimit = getAddressPageLimit(params);
+    std::string strCursor;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    if (nLimit > 0) {
+        bool fRange = start > 0 && end > 0;
+        strCursor = getAddressIndexPage(params, addresses, fRange ? start : 0, fRange ? end : 0, nLimit, addressIndex);
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (start > 0 && end > 0) {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            } else {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
             }
         }
     }
@@ -1092,6 +1268,14 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         }
     }
 
+    if (nLimit > 0) {
+        UniValue page(UniValue::VOBJ);
+        page.push_back(Pair("txids", result));
+        if (!strCursor.empty())
+            page.push_back(Pair("cursor", strCursor));
+        return page;
+    }
+
     return result;
 
 }
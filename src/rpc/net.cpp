@@ -102,6 +102,13 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ]\n"
+            "    \"blockdownload\": {\n"
+            "       \"window\": n,             (numeric) The number of blocks we ask from this peer at once, sized by its speed\n"
+            "       \"blocktime\": n,          (numeric) The average time in seconds this peer takes to deliver a block, 0 if not known yet\n"
+            "       \"blocks\": n,             (numeric) The number of requested blocks this peer delivered\n"
+            "       \"bytes\": n,              (numeric) The total size of those blocks\n"
+            "       \"reassigned\": n          (numeric) The number of blocks requested from other peers because this peer stalled\n"
+            "    }\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,             (numeric) The total bytes sent aggregated by message type\n"
             "       ...\n"
@@ -164,6 +171,13 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            UniValue blockdownload(UniValue::VOBJ);
+            blockdownload.push_back(Pair("window", statestats.nBlocksInFlightMax));
+            blockdownload.push_back(Pair("blocktime", statestats.nAvgBlockTime / 1e6));
+            blockdownload.push_back(Pair("blocks", statestats.nBlocksDownloaded));
+            blockdownload.push_back(Pair("bytes", statestats.nBlockBytesDownloaded));
+            blockdownload.push_back(Pair("reassigned", statestats.nBlocksReassigned));
+            obj.push_back(Pair("blockdownload", blockdownload));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
@@ -344,6 +358,13 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
             "    \"serve_historical_blocks\": true|false,  (boolean) True if serving historical blocks\n"
             "    \"bytes_left_in_cycle\": t,               (numeric) Bytes left in current time cycle\n"
             "    \"time_left_in_cycle\": t                 (numeric) Seconds left in current time cycle\n"
+            "  },\n"
+            "  \"messages\":                              (json object) Received messages processed, by message type\n"
+            "  {\n"
+            "    \"msg\": {                               (json object) Only message types seen so far are listed, unknown types under \"*other*\"\n"
+            "      \"count\": n,                          (numeric) Number of messages processed\n"
+            "      \"time\": n                            (numeric) Total time spent processing them in microseconds\n"
+            "    }, ...\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -366,6 +387,15 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     outboundLimit.push_back(Pair("bytes_left_in_cycle", g_connman->GetOutboundTargetBytesLeft()));
     outboundLimit.push_back(Pair("time_left_in_cycle", g_connman->GetMaxOutboundTimeLeftInCycle()));
     obj.push_back(Pair("uploadtarget", outboundLimit));
+
+    UniValue messages(UniValue::VOBJ);
+    BOOST_FOREACH(const PAIRTYPE(std::string, CNetMsgStats)& item, GetNetMsgStats()) {
+        UniValue stats(UniValue::VOBJ);
+        stats.push_back(Pair("count", item.second.nCount));
+        stats.push_back(Pair("time", item.second.nTimeMicros));
+        messages.push_back(Pair(item.first, stats));
+    }
+    obj.push_back(Pair("messages", messages));
     return obj;
 }
 
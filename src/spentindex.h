@@ -369,5 +369,68 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** Totals over an address's entries in the address index, keyed by CAddressIndexIteratorKey */
+struct CAddressBalanceValue {
+    CAmount balance;
+    CAmount received;
+    unsigned int txCount;
+    int lastHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(VARINT(txCount));
+        READWRITE(lastHeight);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        txCount = 0;
+        lastHeight = 0;
+    }
+
+    bool IsNull() const {
+        return (txCount == 0);
+    }
+};
+
+/**
+ * The totals one block changed, as they were before it. Kept for the blocks the block
+ * index on disk may not know yet, so they can still be rolled back after a crash.
+ */
+struct CAddressBalanceUndo {
+    int nHeight;
+    uint256 hashPrevBlock;
+    //! null values had no record
+    std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > vPrevious;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nHeight);
+        READWRITE(hashPrevBlock);
+        READWRITE(vPrevious);
+    }
+
+    CAddressBalanceUndo() {
+        SetNull();
+    }
+
+    void SetNull() {
+        nHeight = 0;
+        hashPrevBlock.SetNull();
+        vPrevious.clear();
+    }
+};
+
 
 #endif // BITCOIN_SPENTINDEX_H
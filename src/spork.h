@@ -108,6 +108,8 @@ public:
     CSporkManager() {}
 
     void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+    /** Route the message types handled by ProcessSpork here */
+    void RegisterMessageHandlers();
     void ExecuteSpork(int nSporkID, int nValue);
     bool UpdateSpork(int nSporkID, int64_t nValue, CConnman& connman);
 
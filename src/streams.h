@@ -67,6 +67,11 @@ public:
         Init(nTypeIn, nVersionIn);
     }
 
+    CDataStream(vector_type&& vchIn, int nTypeIn, int nVersionIn) : vch(std::move(vchIn))
+    {
+        Init(nTypeIn, nVersionIn);
+    }
+
     CDataStream(const std::vector<char>& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
     {
         Init(nTypeIn, nVersionIn);
@@ -304,7 +309,12 @@ public:
     }
 
     void GetAndClear(CSerializeData &data) {
-        data.insert(data.end(), begin(), end());
+        if (data.empty() && nReadPos == 0) {
+            // nothing to keep on either side, hand over the buffer itself
+            data.swap(vch);
+        } else {
+            data.insert(data.end(), begin(), end());
+        }
         clear();
     }
 
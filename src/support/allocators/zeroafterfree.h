@@ -9,6 +9,7 @@
 #include "support/cleanse.h"
 
 #include <memory>
+#include <type_traits>
 #include <vector>
 
 template <typename T>
@@ -22,10 +23,18 @@ struct zero_after_free_allocator : public std::allocator<T> {
     typedef typename base::reference reference;
     typedef typename base::const_reference const_reference;
     typedef typename base::value_type value_type;
-    zero_after_free_allocator() throw() {}
-    zero_after_free_allocator(const zero_after_free_allocator& a) throw() : base(a) {}
+    // Whether to clear is a property of the memory, it moves along with it
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    //! Clear memory before freeing it, can only be turned off for data that is public anyway
+    bool fCleanse;
+
+    zero_after_free_allocator() throw() : fCleanse(true) {}
+    explicit zero_after_free_allocator(bool fCleanseIn) throw() : fCleanse(fCleanseIn) {}
+    zero_after_free_allocator(const zero_after_free_allocator& a) throw() : base(a), fCleanse(a.fCleanse) {}
     template <typename U>
-    zero_after_free_allocator(const zero_after_free_allocator<U>& a) throw() : base(a)
+    zero_after_free_allocator(const zero_after_free_allocator<U>& a) throw() : base(a), fCleanse(a.fCleanse)
     {
     }
     ~zero_after_free_allocator() throw() {}
@@ -36,13 +45,14 @@ struct zero_after_free_allocator : public std::allocator<T> {
 
     void deallocate(T* p, std::size_t n)
     {
-        if (p != NULL)
+        if (p != NULL && fCleanse)
             memory_cleanse(p, sizeof(T) * n);
         std::allocator<T>::deallocate(p, n);
     }
 };
 
-// Byte-vector that clears its contents before deletion.
+// Byte-vector that clears its contents before deletion, unless it was created
+// with zero_after_free_allocator<char>(false) to hold network data.
 typedef std::vector<char, zero_after_free_allocator<char> > CSerializeData;
 
 #endif // BITCOIN_SUPPORT_ALLOCATORS_ZEROAFTERFREE_H
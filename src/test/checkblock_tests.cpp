@@ -2,7 +2,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainparams.h"
 #include "clientversion.h"
+#include "consensus/merkle.h"
 #include "consensus/validation.h"
 #include "validation.h" // For CheckBlock
 #include "primitives/block.h"
@@ -63,4 +65,70 @@ BOOST_AUTO_TEST_CASE(May15)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(HeaderHashCache)
+{
+    CBlockHeader header = Params().GenesisBlock().GetBlockHeader();
+    const uint256 hashGenesis = Params().GetConsensus().hashGenesisBlock;
+    BOOST_CHECK(header.GetHash() == hashGenesis);
+    BOOST_CHECK(header.GetHash() == hashGenesis);
+
+    // Any change to a header field must invalidate the cached hash
+    header.nNonce++;
+    uint256 hashChanged = header.GetHash();
+    BOOST_CHECK(hashChanged != hashGenesis);
+    header.nNonce--;
+    BOOST_CHECK(header.GetHash() == hashGenesis);
+    header.hashMerkleRoot.SetNull();
+    BOOST_CHECK(header.GetHash() != hashGenesis);
+
+    // Copies and batch hashing agree with the scalar path
+    CBlock block(header);
+    BOOST_CHECK(block.GetHash() == header.GetHash());
+    std::vector<CBlockHeader> headers(5, Params().GenesisBlock().GetBlockHeader());
+    headers[3].nNonce++;
+    std::vector<uint256> hashes;
+    GetBlockHeaderHashes(headers, hashes);
+    BOOST_CHECK(hashes[0] == hashGenesis);
+    BOOST_CHECK(hashes[3] == hashChanged);
+    BOOST_CHECK(headers[3].GetHash() == hashChanged);
+    BOOST_CHECK(headers[4].GetHash() == hashGenesis);
+}
+
+BOOST_FIXTURE_TEST_CASE(ReadIndexedBlock, TestChain100Setup)
+{
+    const CBlockIndex* pindex = chainActive.Tip();
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    BOOST_CHECK(block.GetHash() == pindex->GetBlockHash());
+    BOOST_CHECK(BlockMerkleRoot(block) == pindex->hashMerkleRoot);
+
+    // A block that does not match its index entry must be rejected
+    CBlockIndex indexWrong(*pindex);
+    indexWrong.nNonce++;
+    BOOST_CHECK(!ReadBlockFromDisk(block, &indexWrong, Params().GetConsensus()));
+    indexWrong = *pindex;
+    indexWrong.pprev = pindex->pprev->pprev;
+    BOOST_CHECK(!ReadBlockFromDisk(block, &indexWrong, Params().GetConsensus()));
+}
+
+BOOST_FIXTURE_TEST_CASE(ReadRawBlock, TestChain100Setup)
+{
+    const CBlockIndex* pindex = chainActive.Tip();
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+
+    // The bytes on disk are exactly what a block message carries
+    std::vector<char> vchBlock;
+    BOOST_CHECK(ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos(), Params().MessageStart()));
+    BOOST_CHECK(vchBlock == std::vector<char>(ss.begin(), ss.end()));
+
+    CMessageHeader::MessageStartChars messageStartWrong;
+    memcpy(messageStartWrong, Params().MessageStart(), sizeof(messageStartWrong));
+    messageStartWrong[0] ^= 0xff;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos(), messageStartWrong));
+    BOOST_CHECK(vchBlock.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/neoscrypt.h"
 #include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_mogwai.h"
@@ -273,4 +274,58 @@ BOOST_AUTO_TEST_CASE(pbkdf2_hmac_sha512_test) {
     BOOST_CHECK(HexStr(k, k + 64) == "8c0511f4c6e597c6ac6315d8f0362e225f3c501495ba23b868c005174dc4ee71115b59f9e60cd9532fa33e0f75aefe30225c583a186cd82bd4daea9724a3d3b8");
 }
 
+BOOST_AUTO_TEST_CASE(neoscrypt_testvectors) {
+    // NeoScrypt(128, 2, 1) of the bytes 0 to 79, run through whichever
+    // engine neoscrypt_autodetect() selected for this machine
+    BOOST_CHECK(neoscrypt_autodetect() != NULL);
+
+    unsigned char input[80], output[32];
+    for (int i = 0; i < 80; i++)
+        input[i] = i;
+    neoscrypt(input, output, 0);
+    BOOST_CHECK(HexStr(output, output + 32) == "7258961afb33fd12d00cacb8d63f4f4f52bb6917043865dd24a08f578853122d");
+}
+
+BOOST_AUTO_TEST_CASE(neoscrypt_batch_matches_single) {
+    // Seven passwords exercise both the multi-lane path and the remainder
+    const unsigned int count = 7;
+    std::vector<unsigned char> input(count * 80), output(count * 32), expected(32);
+    for (unsigned int i = 0; i < input.size(); i++)
+        input[i] = insecure_rand();
+
+    neoscrypt_batch(&input[0], &output[0], count);
+    for (unsigned int k = 0; k < count; k++) {
+        neoscrypt(&input[k * 80], &expected[0], 0);
+        BOOST_CHECK(memcmp(&expected[0], &output[k * 32], 32) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(neoscrypt_scan_nonces) {
+    std::vector<unsigned char> header(80), hash(32), expected(32);
+    for (unsigned int i = 0; i < header.size(); i++)
+        header[i] = insecure_rand();
+
+    // Nothing is below a zero target, the whole range is tried
+    std::vector<unsigned char> target(32, 0x00);
+    unsigned int nonce = 0xfffffffe;
+    BOOST_CHECK(!neoscrypt_scan(&header[0], &nonce, 7, &target[0], &hash[0]));
+    BOOST_CHECK_EQUAL(nonce, 5U);
+
+    // Target the hash of the sixth nonce, which is found unless an earlier
+    // nonce happens to hash even lower
+    nonce = 1000 + 5;
+    for (unsigned int i = 0; i < 4; i++)
+        header[76 + i] = (unsigned char)(nonce >> (i * 8));
+    neoscrypt(&header[0], &expected[0], 0);
+    target = expected;
+    unsigned int found = 1000;
+    bool fFound = neoscrypt_scan(&header[0], &found, 7, &target[0], &hash[0]);
+    BOOST_CHECK(fFound);
+    BOOST_CHECK(found <= nonce);
+    for (unsigned int i = 0; i < 4; i++)
+        header[76 + i] = (unsigned char)(found >> (i * 8));
+    neoscrypt(&header[0], &expected[0], 0);
+    BOOST_CHECK(memcmp(&expected[0], &hash[0], 32) == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,8 @@
 #include "dbwrapper.h"
 #include "uint256.h"
 #include "random.h"
+#include "txdb.h"
+#include "validation.h"
 #include "test/test_mogwai.h"
 
 #include <boost/assign/std/vector.hpp> // for 'operator+=()'
@@ -126,6 +128,30 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+// Data written with one tuning profile can be read with another one
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    path ph = temp_directory_path() / unique_path();
+    create_directories(ph);
+
+    BOOST_CHECK_THROW(CDBWrapper(ph, (1 << 10), true, false, false, "nosuchprofile"), dbwrapper_error);
+
+    char key = 'k';
+    uint256 in = GetRandHash();
+    uint256 res;
+    {
+        CDBWrapper dbw(ph, (1 << 20), false, false, false, "index");
+        BOOST_CHECK_EQUAL(dbw.GetProfile().strName, "index");
+        BOOST_CHECK(dbw.GetProfile().fCompression);
+        BOOST_CHECK(dbw.Write(key, in));
+    }
+
+    CDBWrapper dbw(ph, (1 << 20), false, false, false, "default");
+    BOOST_CHECK(!dbw.GetProfile().fCompression);
+    BOOST_CHECK(dbw.Read(key, res));
+    BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+}
+
 // Test that we do not obfuscation if there is existing data.
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
@@ -324,4 +350,167 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
 
 
 
+BOOST_FIXTURE_TEST_CASE(address_balance, TestingSetup)
+{
+    uint256 hash = GetRandHash();
+    uint160 hashBytes(std::vector<unsigned char>(hash.begin(), hash.begin() + 20));
+
+    CIndexDB addressdb("addressindex", 1 << 20, true);
+    CIndexDB balancedb("addressbalance", 1 << 20, true);
+
+    CIndexUpdate update;
+    update.vAddressIndex.push_back(make_pair(CAddressIndexKey(1, hashBytes, 5, 1, GetRandHash(), 0, false), 100));
+    update.vAddressIndex.push_back(make_pair(CAddressIndexKey(1, hashBytes, 9, 2, GetRandHash(), 0, true), -40));
+    CAddressBalanceValue value;
+    value.balance = 60;
+    value.received = 100;
+    value.txCount = 2;
+    value.lastHeight = 9;
+    CIndexUpdate balanceUpdate;
+    balanceUpdate.vAddressBalance.push_back(make_pair(CAddressIndexIteratorKey(1, hashBytes), value));
+    BOOST_CHECK(addressdb.WriteUpdate(update, CBlockLocator()));
+    BOOST_CHECK(balancedb.WriteUpdate(balanceUpdate, CBlockLocator()));
+
+    CAddressBalanceValue res;
+    BOOST_CHECK(balancedb.ReadAddressBalance(hashBytes, 1, res));
+    BOOST_CHECK_EQUAL(res.balance, 60);
+    BOOST_CHECK_EQUAL(res.received, 100);
+    BOOST_CHECK_EQUAL(res.txCount, 2U);
+    BOOST_CHECK_EQUAL(res.lastHeight, 9);
+    BOOST_CHECK(!balancedb.ReadAddressBalance(hashBytes, 2, res));
+
+    // the latest entry below a height
+    int nHeight = 0;
+    BOOST_CHECK(addressdb.ReadAddressLastHeight(hashBytes, 1, 100, nHeight));
+    BOOST_CHECK_EQUAL(nHeight, 9);
+    BOOST_CHECK(addressdb.ReadAddressLastHeight(hashBytes, 1, 9, nHeight));
+    BOOST_CHECK_EQUAL(nHeight, 5);
+    BOOST_CHECK(!addressdb.ReadAddressLastHeight(hashBytes, 1, 5, nHeight));
+    BOOST_CHECK(!addressdb.ReadAddressLastHeight(hashBytes, 2, 100, nHeight));
+
+    // null totals erase the record
+    CIndexUpdate erase;
+    erase.vAddressBalance.push_back(make_pair(CAddressIndexIteratorKey(1, hashBytes), CAddressBalanceValue()));
+    BOOST_CHECK(balancedb.WriteUpdate(erase, CBlockLocator()));
+    BOOST_CHECK(!balancedb.ReadAddressBalance(hashBytes, 1, res));
+}
+
+BOOST_FIXTURE_TEST_CASE(address_balance_undo, TestingSetup)
+{
+    CIndexDB balancedb("addressbalance", 1 << 20, true);
+
+    uint256 hashPrev = GetRandHash();
+    std::vector<uint256> vBlocks;
+    CIndexUpdate update;
+    for (int nHeight = 10; nHeight < 13; nHeight++) {
+        CAddressBalanceUndo undo;
+        undo.nHeight = nHeight;
+        undo.hashPrevBlock = hashPrev;
+        undo.vPrevious.push_back(make_pair(CAddressIndexIteratorKey(1, uint160()), CAddressBalanceValue()));
+        hashPrev = GetRandHash();
+        vBlocks.push_back(hashPrev);
+        update.vAddressBalanceUndo.push_back(make_pair(hashPrev, undo));
+    }
+    BOOST_CHECK(balancedb.WriteUpdate(update, CBlockLocator()));
+
+    CAddressBalanceUndo res;
+    BOOST_CHECK(balancedb.ReadAddressBalanceUndo(vBlocks[2], res));
+    BOOST_CHECK_EQUAL(res.nHeight, 12);
+    BOOST_CHECK(res.hashPrevBlock == vBlocks[1]);
+    BOOST_CHECK_EQUAL(res.vPrevious.size(), 1U);
+
+    // records without a previous block are erased, the ones up to the prune height as well
+    CIndexUpdate prune;
+    prune.vAddressBalanceUndo.push_back(make_pair(vBlocks[2], CAddressBalanceUndo()));
+    prune.nAddressBalanceUndoPruneHeight = 10;
+    BOOST_CHECK(balancedb.WriteUpdate(prune, CBlockLocator()));
+    BOOST_CHECK(!balancedb.ReadAddressBalanceUndo(vBlocks[0], res));
+    BOOST_CHECK(balancedb.ReadAddressBalanceUndo(vBlocks[1], res));
+    BOOST_CHECK(!balancedb.ReadAddressBalanceUndo(vBlocks[2], res));
+}
+
+BOOST_FIXTURE_TEST_CASE(move_legacy_index, TestingSetup)
+{
+    CIndexDB txindexdb("txindex", 1 << 20, true);
+    uint256 txid = GetRandHash();
+    CDiskTxPos pos(CDiskBlockPos(1, 2), 3);
+
+    // the layout of older versions
+    BOOST_CHECK(pblocktree->Write(make_pair('t', txid), pos));
+    BOOST_CHECK(pblocktree->WriteFlag("txindex", true));
+
+    bool fEnabled = false;
+    BOOST_CHECK(pblocktree->HaveLegacyIndex("txindex", fEnabled));
+    BOOST_CHECK(fEnabled);
+
+    CBlockLocator locator(std::vector<uint256>(1, GetRandHash()));
+    BOOST_CHECK(pblocktree->MoveLegacyIndex("txindex", &txindexdb, locator));
+
+    CDiskTxPos res;
+    BOOST_CHECK(txindexdb.ReadTxIndex(txid, res));
+    BOOST_CHECK_EQUAL(res.nFile, 1);
+    BOOST_CHECK_EQUAL(res.nTxOffset, 3U);
+    CBlockLocator locatorBest;
+    BOOST_CHECK(txindexdb.ReadBestBlock(locatorBest));
+    BOOST_CHECK(locatorBest.vHave == locator.vHave);
+
+    BOOST_CHECK(!pblocktree->Exists(make_pair('t', txid)));
+    BOOST_CHECK(!pblocktree->HaveLegacyIndex("txindex", fEnabled));
+
+    // an index that is off is dropped with its flag
+    BOOST_CHECK(pblocktree->Write(make_pair('s', CTimestampIndexKey(1, GetRandHash())), 0));
+    BOOST_CHECK(pblocktree->WriteFlag("timestampindex", true));
+    BOOST_CHECK(pblocktree->WriteLegacyIndexBestBlock("timestampindex", GetRandHash()));
+    BOOST_CHECK(pblocktree->MoveLegacyIndex("timestampindex", NULL, CBlockLocator()));
+    uint256 hashLegacy;
+    BOOST_CHECK(!pblocktree->HaveLegacyIndex("timestampindex", fEnabled));
+    BOOST_CHECK(!pblocktree->ReadLegacyIndexBestBlock("timestampindex", hashLegacy));
+    boost::scoped_ptr<CDBIterator> pcursor(pblocktree->NewIterator());
+    pcursor->Seek('s');
+    std::pair<char, CTimestampIndexKey> key;
+    BOOST_CHECK(!pcursor->Valid() || !pcursor->GetKey(key) || key.first != 's');
+}
+
+BOOST_FIXTURE_TEST_CASE(address_index_page, TestingSetup)
+{
+    uint256 hash = GetRandHash();
+    uint160 hashBytes(std::vector<unsigned char>(hash.begin(), hash.begin() + 20));
+
+    CIndexDB addressdb("addressindex", 1 << 20, true);
+
+    CIndexUpdate update;
+    for (int i = 1; i <= 5; i++)
+        update.vAddressIndex.push_back(make_pair(CAddressIndexKey(1, hashBytes, i, 1, GetRandHash(), 0, false), i));
+    // same hash, other type
+    update.vAddressIndex.push_back(make_pair(CAddressIndexKey(2, hashBytes, 3, 1, GetRandHash(), 0, false), 100));
+    std::vector<uint256> vHave;
+    vHave.push_back(GetRandHash());
+    vHave.push_back(GetRandHash());
+    BOOST_CHECK(addressdb.WriteUpdate(update, CBlockLocator(vHave)));
+
+    CBlockLocator locatorBest;
+    BOOST_CHECK(addressdb.ReadBestBlock(locatorBest));
+    BOOST_CHECK(locatorBest.vHave == vHave);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vPage;
+    bool fMore = false;
+    BOOST_CHECK(addressdb.ReadAddressIndexPage(hashBytes, 1, 0, 0, NULL, 2, vPage, fMore));
+    BOOST_CHECK_EQUAL(vPage.size(), 2U);
+    BOOST_CHECK(fMore);
+
+    // continue after the last key, reading the rest
+    CAddressIndexKey keyAfter = vPage.back().first;
+    BOOST_CHECK(addressdb.ReadAddressIndexPage(hashBytes, 1, 0, 0, &keyAfter, 3, vPage, fMore));
+    BOOST_CHECK_EQUAL(vPage.size(), 5U);
+    BOOST_CHECK(!fMore);
+    for (int i = 0; i < 5; i++)
+        BOOST_CHECK_EQUAL(vPage[i].second, i + 1);
+
+    // height range
+    vPage.clear();
+    BOOST_CHECK(addressdb.ReadAddressIndexPage(hashBytes, 1, 2, 3, NULL, 0, vPage, fMore));
+    BOOST_CHECK_EQUAL(vPage.size(), 2U);
+    BOOST_CHECK(!fMore);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,53 @@
+// Copyright (c) 2017-2018 The Mogwai Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternodeman.h"
+
+#include "test/test_mogwai.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(masternodeman_tests, BasicTestingSetup)
+
+static CTransaction MakeCoinbase(const std::vector<std::pair<CScript, CAmount> >& vPayments)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.SetNull();
+    for (const auto& payment : vPayments)
+        tx.vout.push_back(CTxOut(payment.second, payment.first));
+    return CTransaction(tx);
+}
+
+BOOST_AUTO_TEST_CASE(paid_payees_duplicate_outputs)
+{
+    const CAmount nPayment = 5 * COIN;
+    CScript payee = CScript() << OP_TRUE;
+    CScript other = CScript() << OP_FALSE;
+
+    std::vector<std::pair<CScript, CAmount> > vPayments;
+    vPayments.push_back(std::make_pair(payee, nPayment));
+    // the same script paid the masternode amount twice in one coinbase
+    vPayments.push_back(std::make_pair(payee, nPayment));
+    vPayments.push_back(std::make_pair(other, 3 * COIN));
+
+    CMasternodePaidPayees paidPayees;
+    paidPayees.AddBlock(10, MakeCoinbase(vPayments), nPayment);
+    paidPayees.AddBlock(11, MakeCoinbase(vPayments), nPayment);
+
+    const std::map<CScript, std::set<int> >& mapHeights = paidPayees.GetPayeeHeights();
+    BOOST_CHECK_EQUAL(mapHeights.size(), 1U);
+    BOOST_CHECK_EQUAL(mapHeights.at(payee).size(), 2U);
+
+    // the window moves past height 10
+    paidPayees.KeepRange(11, 12);
+    BOOST_CHECK_EQUAL(mapHeights.at(payee).size(), 1U);
+    BOOST_CHECK_EQUAL(*mapHeights.at(payee).begin(), 11);
+
+    // and past height 11, which drops the payee
+    paidPayees.KeepRange(12, 12);
+    BOOST_CHECK(mapHeights.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
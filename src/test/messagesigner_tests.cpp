@@ -0,0 +1,52 @@
+// Copyright (c) 2017-2018 The Mogwai Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "messagesigner.h"
+#include "random.h"
+#include "util.h"
+
+#include "test/test_mogwai.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(messagesigner_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(messagesigner_cache)
+{
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CPubKey pubkeyOther = keyOther.GetPubKey();
+
+    std::string strMessage = "mnp test message";
+    std::vector<unsigned char> vchSig;
+    std::string strError;
+    BOOST_CHECK(CMessageSigner::SignMessage(strMessage, vchSig, key));
+
+    // the second check of the same signature is answered by the cache
+    BOOST_CHECK(CMessageSigner::VerifyMessage(pubkey, vchSig, strMessage, strError));
+    BOOST_CHECK(CMessageSigner::VerifyMessage(pubkey, vchSig, strMessage, strError));
+
+    // a cached signature is not valid for another key or another message
+    BOOST_CHECK(!CMessageSigner::VerifyMessage(pubkeyOther, vchSig, strMessage, strError));
+    BOOST_CHECK(!CMessageSigner::VerifyMessage(pubkey, vchSig, strMessage + "x", strError));
+
+    std::vector<unsigned char> vchSigBad(vchSig);
+    vchSigBad[10] ^= 1;
+    BOOST_CHECK(!CMessageSigner::VerifyMessage(pubkey, vchSigBad, strMessage, strError));
+    BOOST_CHECK(!CMessageSigner::VerifyMessage(pubkey, vchSigBad, strMessage, strError));
+
+    // verification works the same with the cache turned off
+    mapArgs["-maxmsgsigcachesize"] = "0";
+    uint256 hash = GetRandHash();
+    BOOST_CHECK(CHashSigner::SignHash(hash, keyOther, vchSig));
+    BOOST_CHECK(CHashSigner::VerifyHash(hash, pubkeyOther, vchSig, strError));
+    BOOST_CHECK(CHashSigner::VerifyHash(hash, pubkeyOther, vchSig, strError));
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash, pubkey, vchSig, strError));
+    mapArgs.erase("-maxmsgsigcachesize");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -174,4 +174,51 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+static std::vector<char> MakeRawMessage(const std::string& strCommand, const std::vector<char>& vchPayload)
+{
+    CMessageHeader hdr(Params().MessageStart(), strCommand.c_str(), vchPayload.size());
+    uint256 hash = Hash(vchPayload.begin(), vchPayload.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hdr;
+    ss.insert(ss.end(), vchPayload.begin(), vchPayload.end());
+    return std::vector<char>(ss.begin(), ss.end());
+}
+
+BOOST_AUTO_TEST_CASE(cnode_receive_checksum)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, "", true);
+
+    std::vector<char> vchPayload(1000);
+    for (size_t i = 0; i < vchPayload.size(); i++)
+        vchPayload[i] = i & 0xff;
+    std::vector<char> vchMessage = MakeRawMessage("ping", vchPayload);
+
+    // The checksum is accumulated over several reads
+    bool complete = false;
+    size_t nPos = 0;
+    while (nPos < vchMessage.size()) {
+        unsigned int nChunk = std::min<size_t>(97, vchMessage.size() - nPos);
+        BOOST_CHECK(node.ReceiveMsgBytes(&vchMessage[nPos], nChunk, complete));
+        nPos += nChunk;
+        BOOST_CHECK_EQUAL(complete, nPos == vchMessage.size());
+    }
+
+    // A corrupted payload is dropped instead of being queued
+    vchMessage.back() ^= 1;
+    BOOST_CHECK(node.ReceiveMsgBytes(&vchMessage[0], vchMessage.size(), complete));
+    BOOST_CHECK(!complete);
+    vchMessage.back() ^= 1;
+    BOOST_CHECK(node.ReceiveMsgBytes(&vchMessage[0], vchMessage.size(), complete));
+    BOOST_CHECK(complete);
+
+    // Bad network magic disconnects
+    vchMessage = MakeRawMessage("ping", vchPayload);
+    vchMessage[0] ^= 1;
+    BOOST_CHECK(!node.ReceiveMsgBytes(&vchMessage[0], vchMessage.size(), complete));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
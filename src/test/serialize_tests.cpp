@@ -317,6 +317,21 @@ BOOST_AUTO_TEST_CASE(insert_delete)
     CSerializeData d;
     ss.GetAndClear(d);
     BOOST_CHECK_EQUAL(ss.size(), 0);
+    BOOST_CHECK_EQUAL(d.size(), 4);
+    BOOST_CHECK_EQUAL(d[3], (char)0xff);
+
+    // A buffer handed over as a whole keeps its allocator
+    CDataStream ssPublic(CSerializeData(CSerializeData::allocator_type(false)), SER_DISK, CLIENT_VERSION);
+    ssPublic << (int32_t)1;
+    CSerializeData d2;
+    ssPublic.GetAndClear(d2);
+    BOOST_CHECK_EQUAL(ssPublic.size(), 0);
+    BOOST_CHECK_EQUAL(d2.size(), 4);
+    BOOST_CHECK(!d2.get_allocator().fCleanse);
+    d2.insert(d2.end(), 4, 0);
+    ss.GetAndClear(d2);
+    BOOST_CHECK_EQUAL(d2.size(), 8);
+    BOOST_CHECK(!d2.get_allocator().fCleanse);
 }
 
 // Change struct size and check if it can be deserialized
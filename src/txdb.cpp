@@ -11,9 +11,12 @@
 #include "uint256.h"
 #include "ui_interface.h"
 #include "init.h"
+#include "validation.h"
 
+#include <algorithm>
 #include <stdint.h>
 
+#include <boost/algorithm/string/join.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -24,6 +27,8 @@ static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSBALANCE = 'A';
+static const char DB_ADDRESSBALANCEUNDO = 'U';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_SPENTINDEX = 'p';
 static const char DB_BLOCK_INDEX = 'b';
@@ -32,6 +37,7 @@ static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_INDEX_BEST_BLOCK = 'I';
 
 namespace {
 
@@ -57,7 +63,79 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+std::vector<std::string> GetIndexNames()
+{
+    // the address balance totals are kept apart, so they can be built for existing address indexes
+    return {"txindex", "addressindex", "addressbalance", "spentindex", "timestampindex"};
+}
+
+bool GetIndexArg(const std::string& strName)
+{
+    if (strName == "txindex")
+        return GetBoolArg("-txindex", DEFAULT_TXINDEX);
+    if (strName == "addressindex" || strName == "addressbalance")
+        return GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    if (strName == "spentindex")
+        return GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    if (strName == "timestampindex")
+        return GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+    return false;
+}
+
+std::vector<std::string> GetDBNames()
+{
+    std::vector<std::string> vNames = {"chainstate", "blockindex"};
+    for (const std::string& strName : GetIndexNames())
+        vNames.push_back(strName);
+    return vNames;
+}
+
+std::string GetDBProfileArg(const std::string& strDB)
+{
+    for (const std::string& strArg : mapMultiArgs["-dbprofile"]) {
+        size_t nPos = strArg.find(':');
+        if (nPos != std::string::npos && strArg.substr(0, nPos) == strDB)
+            return strArg.substr(nPos + 1);
+    }
+
+    std::vector<std::string> vIndexes = GetIndexNames();
+    if (std::find(vIndexes.begin(), vIndexes.end(), strDB) != vIndexes.end())
+        return "index";
+    return "default";
+}
+
+bool CheckDBProfileArgs(std::string& strError)
+{
+    std::vector<std::string> vNames = GetDBNames();
+    for (const std::string& strArg : mapMultiArgs["-dbprofile"]) {
+        size_t nPos = strArg.find(':');
+        CDBProfile profile;
+        if (nPos == std::string::npos || std::find(vNames.begin(), vNames.end(), strArg.substr(0, nPos)) == vNames.end() ||
+            !GetDBProfile(strArg.substr(nPos + 1), profile)) {
+            strError = strprintf("Invalid -dbprofile=%s, use <%s>:<%s>", strArg, boost::algorithm::join(vNames, "|"),
+                                 boost::algorithm::join(GetDBProfileNames(), "|"));
+            return false;
+        }
+    }
+    return true;
+}
+
+int GetDBMaxOpenFiles()
+{
+    int nFiles = 0;
+    std::vector<std::string> vIndexes = GetIndexNames();
+    for (const std::string& strDB : GetDBNames()) {
+        if (std::find(vIndexes.begin(), vIndexes.end(), strDB) != vIndexes.end() && !GetIndexArg(strDB))
+            continue;
+        CDBProfile profile;
+        if (GetDBProfile(GetDBProfileArg(strDB), profile))
+            nFiles += profile.nMaxOpenFiles;
+    }
+    return nFiles;
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) :
+    db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, GetDBProfileArg("chainstate"))
 {
 }
 
@@ -106,7 +184,21 @@ size_t CCoinsViewDB::EstimateSize() const
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) :
+    CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, GetDBProfileArg("blockindex")) {
+}
+
+/** Location of an index database, indexes/ is created on the way */
+static boost::filesystem::path GetIndexDBPath(const std::string &strName, bool fMemory)
+{
+    boost::filesystem::path path = GetDataDir() / "indexes";
+    if (!fMemory)
+        TryCreateDirectory(path);
+    return path / strName;
+}
+
+CIndexDB::CIndexDB(const std::string &strName, size_t nCacheSize, bool fMemory, bool fWipe) :
+    CDBWrapper(GetIndexDBPath(strName, fMemory), nCacheSize, fMemory, fWipe, false, GetDBProfileArg(strName)) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -195,59 +287,49 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
+bool CIndexDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(make_pair(DB_TXINDEX, txid), pos);
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
+bool CIndexDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
     return Read(make_pair(DB_SPENTINDEX, key), value);
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
-        } else {
-            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
-        }
-    }
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
-        } else {
-            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
-        }
-    }
-    return WriteBatch(batch);
+bool CIndexDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
+                                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+    bool fMore;
+    return ReadAddressUnspentIndexPage(addressHash, type, NULL, 0, unspentOutputs, fMore);
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+bool CIndexDB::ReadAddressUnspentIndexPage(uint160 addressHash, int type, const CAddressUnspentKey *pkeyAfter, size_t nLimit,
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs, bool &fMore) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    if (pkeyAfter) {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, *pkeyAfter));
+    } else {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
 
+    fMore = false;
+    size_t nCount = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressUnspentKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash && key.second.type == (unsigned int)type) {
+            if (pkeyAfter && key.second.txhash == pkeyAfter->txhash && key.second.index == pkeyAfter->index) {
+                pcursor->Next();
+                continue;
+            }
+            if (nLimit > 0 && nCount == nLimit) {
+                fMore = true;
+                break;
+            }
             CAddressUnspentValue nValue;
             if (pcursor->GetValue(nValue)) {
                 unspentOutputs.push_back(make_pair(key.second, nValue));
+                nCount++;
                 pcursor->Next();
             } else {
                 return error("failed to get address unspent value");
@@ -260,42 +342,49 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
+bool CIndexDB::ReadAddressIndex(uint160 addressHash, int type,
+                                std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                int start, int end) {
+    bool fMore;
+    return ReadAddressIndexPage(addressHash, type, start > 0 && end > 0 ? start : 0, end, NULL, 0, addressIndex, fMore);
 }
 
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
-                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
+bool CIndexDB::ReadAddressIndexPage(uint160 addressHash, int type, int start, int end,
+                                    const CAddressIndexKey *pkeyAfter, size_t nLimit,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, bool &fMore) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (start > 0 && end > 0) {
+    if (pkeyAfter) {
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, *pkeyAfter));
+    } else if (start > 0) {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
     } else {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
     }
 
+    fMore = false;
+    size_t nCount = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash && key.second.type == (unsigned int)type) {
             if (end > 0 && key.second.blockHeight > end) {
                 break;
             }
+            if (pkeyAfter && key.second.blockHeight == pkeyAfter->blockHeight && key.second.txindex == pkeyAfter->txindex &&
+                key.second.txhash == pkeyAfter->txhash && key.second.index == pkeyAfter->index && key.second.spending == pkeyAfter->spending) {
+                pcursor->Next();
+                continue;
+            }
+            if (nLimit > 0 && nCount == nLimit) {
+                fMore = true;
+                break;
+            }
             CAmount nValue;
             if (pcursor->GetValue(nValue)) {
                 addressIndex.push_back(make_pair(key.second, nValue));
+                nCount++;
                 pcursor->Next();
             } else {
                 return error("failed to get address index value");
@@ -308,13 +397,31 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(*this);
-    batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
+bool CIndexDB::ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value) {
+    return Read(make_pair(DB_ADDRESSBALANCE, CAddressIndexIteratorKey(type, addressHash)), value);
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes) {
+bool CIndexDB::ReadAddressLastHeight(uint160 addressHash, int type, int nBelowHeight, int &nHeight) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    // the entry before the first one at nBelowHeight, if it's still this address's
+    pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, nBelowHeight)));
+    if (pcursor->Valid())
+        pcursor->Prev();
+    else
+        pcursor->SeekToLast();
+
+    std::pair<char,CAddressIndexKey> key;
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX ||
+        key.second.type != (unsigned int)type || key.second.hashBytes != addressHash)
+        return false;
+
+    nHeight = key.second.blockHeight;
+    return true;
+}
+
+bool CIndexDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -334,6 +441,74 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
     return true;
 }
 
+bool CIndexDB::ReadAddressBalanceUndo(const uint256 &hashBlock, CAddressBalanceUndo &undo) {
+    return Read(make_pair(DB_ADDRESSBALANCEUNDO, hashBlock), undo);
+}
+
+bool CIndexDB::ReadBestBlock(CBlockLocator &locator) {
+    return Read(DB_BEST_BLOCK, locator);
+}
+
+bool CIndexDB::WriteBestBlock(const CBlockLocator &locator) {
+    return Write(DB_BEST_BLOCK, locator, true);
+}
+
+bool CIndexDB::WriteUpdate(const CIndexUpdate &update, const CBlockLocator &locator) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=update.vTxIndex.begin(); it!=update.vTxIndex.end(); it++)
+        batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=update.vAddressIndex.begin(); it!=update.vAddressIndex.end(); it++)
+        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=update.vAddressIndexErase.begin(); it!=update.vAddressIndexErase.end(); it++)
+        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=update.vAddressUnspentIndex.begin(); it!=update.vAddressUnspentIndex.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+        }
+    }
+    for (std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> >::const_iterator it=update.vAddressBalance.begin(); it!=update.vAddressBalance.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSBALANCE, it->first));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSBALANCE, it->first), it->second);
+        }
+    }
+    for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=update.vSpentIndex.begin(); it!=update.vSpentIndex.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+        }
+    }
+    for (std::vector<CTimestampIndexKey>::const_iterator it=update.vTimestampIndex.begin(); it!=update.vTimestampIndex.end(); it++)
+        batch.Write(make_pair(DB_TIMESTAMPINDEX, *it), 0);
+    for (std::vector<CTimestampIndexKey>::const_iterator it=update.vTimestampIndexErase.begin(); it!=update.vTimestampIndexErase.end(); it++)
+        batch.Erase(make_pair(DB_TIMESTAMPINDEX, *it));
+    for (std::vector<std::pair<uint256, CAddressBalanceUndo> >::const_iterator it=update.vAddressBalanceUndo.begin(); it!=update.vAddressBalanceUndo.end(); it++) {
+        if (it->second.hashPrevBlock.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSBALANCEUNDO, it->first));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSBALANCEUNDO, it->first), it->second);
+        }
+    }
+    if (update.nAddressBalanceUndoPruneHeight >= 0) {
+        // only the blocks the block index may not have written yet have a record, there are few
+        boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+        for (pcursor->Seek(DB_ADDRESSBALANCEUNDO); pcursor->Valid(); pcursor->Next()) {
+            std::pair<char, uint256> key;
+            CAddressBalanceUndo undo;
+            if (!pcursor->GetKey(key) || key.first != DB_ADDRESSBALANCEUNDO)
+                break;
+            if (pcursor->GetValue(undo) && undo.nHeight <= update.nAddressBalanceUndoPruneHeight)
+                batch.Erase(key);
+        }
+    }
+    batch.Write(DB_BEST_BLOCK, locator);
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -346,6 +521,96 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+bool CBlockTreeDB::HaveLegacyIndex(const std::string &name, bool &fEnabled) {
+    // older versions recorded every index they had ever seen with a flag
+    return ReadFlag(name, fEnabled);
+}
+
+bool CBlockTreeDB::ReadLegacyIndexBestBlock(const std::string &name, uint256 &hashBlock) {
+    return Read(std::make_pair(DB_INDEX_BEST_BLOCK, name), hashBlock);
+}
+
+bool CBlockTreeDB::WriteLegacyIndexBestBlock(const std::string &name, const uint256 &hashBlock) {
+    return Write(std::make_pair(DB_INDEX_BEST_BLOCK, name), hashBlock, true);
+}
+
+namespace {
+
+/** Move the entries of one type from the block tree database to pto, or erase them if pto is NULL */
+template <typename K, typename V>
+bool MoveLegacyEntries(CDBWrapper &from, CDBWrapper *pto, char chType, const std::string &name)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(from.NewIterator());
+    CDBBatch batchFrom(from);
+    boost::scoped_ptr<CDBBatch> pbatchTo(pto ? new CDBBatch(*pto) : NULL);
+    size_t batch_size = 1 << 24;
+    int64_t nCount = 0;
+
+    pcursor->Seek(chType);
+    while (true) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            return false;
+
+        std::pair<char, K> key;
+        bool fDone = !pcursor->Valid() || !pcursor->GetKey(key) || key.first != chType;
+        if (!fDone) {
+            if (pto) {
+                V value;
+                if (!pcursor->GetValue(value))
+                    return error("%s: cannot parse %s record", __func__, name);
+                pbatchTo->Write(key, value);
+            }
+            batchFrom.Erase(key);
+            nCount++;
+        }
+
+        if (fDone || batchFrom.SizeEstimate() + (pto ? pbatchTo->SizeEstimate() : 0) > batch_size) {
+            // the copy has to be on disk before the old entries go
+            if (pto && !pto->WriteBatch(*pbatchTo, true))
+                return false;
+            if (!from.WriteBatch(batchFrom))
+                return false;
+            if (pto)
+                pbatchTo->Clear();
+            batchFrom.Clear();
+            LogPrintf("%s: %s %d entries of %s\n", __func__, pto ? "moved" : "dropped", nCount, name);
+        }
+
+        if (fDone)
+            return true;
+        pcursor->Next();
+    }
+}
+
+} // anon namespace
+
+bool CBlockTreeDB::MoveLegacyIndex(const std::string &name, CIndexDB *pindexdb, const CBlockLocator &locator) {
+    bool fOk = true;
+    if (name == "txindex") {
+        fOk = MoveLegacyEntries<uint256, CDiskTxPos>(*this, pindexdb, DB_TXINDEX, name);
+    } else if (name == "addressindex") {
+        fOk = MoveLegacyEntries<CAddressIndexKey, CAmount>(*this, pindexdb, DB_ADDRESSINDEX, name) &&
+              MoveLegacyEntries<CAddressUnspentKey, CAddressUnspentValue>(*this, pindexdb, DB_ADDRESSUNSPENTINDEX, name);
+    } else if (name == "addressbalance") {
+        fOk = MoveLegacyEntries<CAddressIndexIteratorKey, CAddressBalanceValue>(*this, pindexdb, DB_ADDRESSBALANCE, name);
+    } else if (name == "spentindex") {
+        fOk = MoveLegacyEntries<CSpentIndexKey, CSpentIndexValue>(*this, pindexdb, DB_SPENTINDEX, name);
+    } else if (name == "timestampindex") {
+        fOk = MoveLegacyEntries<CTimestampIndexKey, int>(*this, pindexdb, DB_TIMESTAMPINDEX, name);
+    }
+    if (!fOk)
+        return false;
+
+    // an interrupted move picks up where it stopped, as long as the flag is there
+    if (pindexdb && !pindexdb->WriteBestBlock(locator))
+        return false;
+    CDBBatch batch(*this);
+    batch.Erase(std::make_pair(DB_FLAG, name));
+    batch.Erase(std::make_pair(DB_INDEX_BEST_BLOCK, name));
+    return WriteBatch(batch, true);
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
@@ -20,6 +20,7 @@
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
+class CIndexDB;
 class uint256;
 
 //! Compensate for extra memory peak (x1.5-x1.9) at flush time.
@@ -32,15 +33,29 @@ static const int64_t nDefaultDbCache = 300;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
 static const int64_t nMinDbCache = 4;
-//! Max memory allocated to block tree DB specific cache, if no -txindex (MiB)
+//! Max memory allocated to block tree DB specific cache (MiB)
 static const int64_t nMaxBlockDBCache = 2;
-//! Max memory allocated to block tree DB specific cache, if -txindex (MiB)
+//! Max memory allocated to the caches of the optional index DBs together (MiB)
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
-static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
+static const int64_t nMaxIndexDBCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
+/** Names of the optional indexes, each kept in a database of its own under indexes/ */
+std::vector<std::string> GetIndexNames();
+/** Whether an optional index is turned on by its option (-txindex, -addressindex, ...) */
+bool GetIndexArg(const std::string& strName);
+
+/** Names of the databases -dbprofile applies to */
+std::vector<std::string> GetDBNames();
+/** LevelDB tuning profile of a database, from -dbprofile=<database>:<profile> or the default */
+std::string GetDBProfileArg(const std::string& strDB);
+/** Check the -dbprofile options, strError is set if one is invalid */
+bool CheckDBProfileArgs(std::string& strError);
+/** File descriptors the databases that are in use may keep open in total */
+int GetDBMaxOpenFiles();
+
 struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
@@ -66,6 +81,28 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/** Changes to the optional indexes for connecting or disconnecting one block */
+struct CIndexUpdate
+{
+    std::vector<std::pair<uint256, CDiskTxPos> > vTxIndex;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndexErase;
+    //! null values are erased
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspentIndex;
+    //! null values are erased
+    std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > vAddressBalance;
+    //! null values are erased
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpentIndex;
+    std::vector<CTimestampIndexKey> vTimestampIndex;
+    std::vector<CTimestampIndexKey> vTimestampIndexErase;
+    //! by block hash, records without hashPrevBlock are erased
+    std::vector<std::pair<uint256, CAddressBalanceUndo> > vAddressBalanceUndo;
+    //! balance undo records up to this height are erased, -1 for none
+    int nAddressBalanceUndoPruneHeight;
+
+    CIndexUpdate() : nAddressBalanceUndoPruneHeight(-1) {}
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
@@ -74,6 +111,8 @@ protected:
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
+    const CDBWrapper& GetDB() const { return db; }
+
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
@@ -121,23 +160,50 @@ public:
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
+    bool WriteFlag(const std::string &name, bool fValue);
+    bool ReadFlag(const std::string &name, bool &fValue);
+    //! Whether older versions left an index in this database, fEnabled tells if it was kept up to date
+    bool HaveLegacyIndex(const std::string &name, bool &fEnabled);
+    //! The block older versions had an index synced to, if they recorded it
+    bool ReadLegacyIndexBestBlock(const std::string &name, uint256 &hashBlock);
+    bool WriteLegacyIndexBestBlock(const std::string &name, const uint256 &hashBlock);
+    //! Move the entries of an index kept here by older versions to pindexdb synced to locator, or drop them if pindexdb is NULL
+    bool MoveLegacyIndex(const std::string &name, CIndexDB *pindexdb, const CBlockLocator &locator);
+    bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+};
+
+/** Access to the database of one optional index (indexes/<name>/) */
+class CIndexDB : public CDBWrapper
+{
+public:
+    CIndexDB(const std::string &strName, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CIndexDB(const CIndexDB&);
+    void operator=(const CIndexDB&);
+public:
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
-    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
-    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
-    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
-    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    //! Up to nLimit (0 for all) unspent outputs of an address after *pkeyAfter, fMore tells whether there are more
+    bool ReadAddressUnspentIndexPage(uint160 addressHash, int type, const CAddressUnspentKey *pkeyAfter, size_t nLimit,
+                                     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect, bool &fMore);
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
-    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
+    //! Up to nLimit (0 for all) entries of an address from height start, or after *pkeyAfter, to height end
+    bool ReadAddressIndexPage(uint160 addressHash, int type, int start, int end,
+                              const CAddressIndexKey *pkeyAfter, size_t nLimit,
+                              std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, bool &fMore);
+    bool ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value);
+    bool ReadAddressLastHeight(uint160 addressHash, int type, int nBelowHeight, int &nHeight);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &vect);
-    bool WriteFlag(const std::string &name, bool fValue);
-    bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    bool ReadAddressBalanceUndo(const uint256 &hashBlock, CAddressBalanceUndo &undo);
+    //! Locator of the last block whose changes are in the index
+    bool ReadBestBlock(CBlockLocator &locator);
+    bool WriteBestBlock(const CBlockLocator &locator);
+    //! Apply the changes of one block, after which the index is synced to the block at the start of locator
+    bool WriteUpdate(const CIndexUpdate &update, const CBlockLocator &locator);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -45,4 +45,8 @@ static const int SENDHEADERS_VERSION = 70201;
 //! DIP0001 was activated in this version
 static const int DIP0001_PROTOCOL_VERSION = 70208;
 
+//! "sendcmpct" is offered to peers starting with this version, compact blocks are
+//! only used with peers that answer with one, older nodes ignore the message
+static const int SHORT_IDS_BLOCKS_VERSION = 70209;
+
 #endif // BITCOIN_VERSION_H